@@ -10,225 +10,5662 @@
 #include <stdexcept>
 #include <iomanip>
 #include <sstream>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <cctype>
+#include <chrono>
+#include <type_traits>
+#include <charconv>
+#include <fstream>
+#include <memory_resource>
+#include <string_view>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <cerrno>
+#include <cstdint>
+#include <system_error>
+#include <random>
+#include <queue>
+#include <tuple>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <regex>
+#if defined(__unix__) || defined(__APPLE__)
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <poll.h>
+#include <linux/io_uring.h>
+#include <sys/inotify.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#endif
 // using namespace std;
 namespace fs = std::filesystem;
 // 목표: Composite 패턴을 이용하여 파일과 디렉터리를 구상하고, 계층 구조에서의 동작을 처리하는 프로그램을 작성하는 것이 목표임
 
+class Directory;
+
+// 계측 계층 (g++ -DFS_INSTRUMENT 로 컴파일하면 켜짐)
+// 꺼져 있으면 아래 FS_ 매크로는 아무 코드도 만들지 않음
+//   FS_PHASE_SCOPE(phase): 구간 호출 수와 시간. 트레이스가 켜져 있으면 Chrome trace 이벤트로도 남김
+//   FS_DIRECTORY_SCOPE(path, depth, entries): 디렉터리 하나를 읽는 시간 (깊이별 지연, 가장 느린 디렉터리)
+// 켜져 있으면 전역 operator new도 바꿔서 힙 할당 횟수와 바이트 수를 셈
+enum class InstrumentPhase { Scan, ReadDirectory, Display, Serialize, Deserialize, Count };
+
+#ifdef FS_INSTRUMENT
+class Instrumentation {
+  public:
+    static constexpr int maxDepth = 64;  // 이보다 깊으면 마지막 칸에 모음
+    static constexpr size_t slowestKept = 10;
+
+    struct PhaseStats {
+      std::atomic<long long> calls{0};
+      std::atomic<long long> nanoseconds{0};
+    };
+    struct SlowDirectory {
+      std::string path;
+      long long nanoseconds;
+      long long entries;
+    };
+    struct TraceEvent {
+      InstrumentPhase phase;
+      long long startUs;
+      long long durationUs;
+      size_t thread;
+    };
+
+    PhaseStats phases[static_cast<int>(InstrumentPhase::Count)];
+    PhaseStats depthLatency[maxDepth];
+    std::atomic<long long> directoryEntries{0};
+    std::atomic<long long> allocations{0};
+    std::atomic<long long> allocatedBytes{0};
+
+  private:
+    std::mutex lock;
+    std::vector<SlowDirectory> slowest;           // 느린 순 (lock)
+    std::atomic<long long> slowestThreshold{0};   // slowest가 꽉 찼을 때 마지막 값 (잠금 없이 거르기용)
+    std::vector<TraceEvent> events;               // (lock)
+    std::atomic<bool> tracing{false};
+    std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+
+    static long long elapsedNs(std::chrono::steady_clock::time_point start) {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+  public:
+    static Instrumentation &get() {
+      static Instrumentation instance;
+      return instance;
+    }
+
+    static const char *phaseName(InstrumentPhase phase) {
+      switch (phase) {
+        case InstrumentPhase::Scan: return "scan";
+        case InstrumentPhase::ReadDirectory: return "read_directory";
+        case InstrumentPhase::Display: return "display";
+        case InstrumentPhase::Serialize: return "serialize";
+        case InstrumentPhase::Deserialize: return "deserialize";
+        default: return "unknown";
+      }
+    }
+
+    void enableTrace() { tracing = true; }
+
+    void recordPhase(InstrumentPhase phase, std::chrono::steady_clock::time_point start, long long ns) {
+      PhaseStats &stats = phases[static_cast<int>(phase)];
+      ++stats.calls;
+      stats.nanoseconds += ns;
+      if (!tracing) { return; }
+      long long startUs = std::chrono::duration_cast<std::chrono::microseconds>(start - origin).count();
+      std::lock_guard<std::mutex> guard(lock);
+      events.push_back({phase, startUs, ns / 1000, std::hash<std::thread::id>()(std::this_thread::get_id())});
+    }
+
+    void recordDirectory(const fs::path &path, int depth, long long entries, long long ns) {
+      PhaseStats &stats = depthLatency[std::min(depth, maxDepth - 1)];
+      ++stats.calls;
+      stats.nanoseconds += ns;
+      directoryEntries += entries;
+      if (ns <= slowestThreshold) { return; }
+      std::lock_guard<std::mutex> guard(lock);
+      auto at = std::find_if(slowest.begin(), slowest.end(),
+                             [ns](const SlowDirectory &d) { return d.nanoseconds < ns; });
+      slowest.insert(at, {path.string(), ns, entries});
+      if (slowest.size() > slowestKept) { slowest.pop_back(); }
+      if (slowest.size() == slowestKept) { slowestThreshold = slowest.back().nanoseconds; }
+    }
+
+    // 사람이 읽는 요약
+    void writeSummary(std::ostream &out) {
+      auto seconds = [](long long ns) { return static_cast<double>(ns) / 1e9; };
+      out << std::fixed << std::setprecision(6);
+      for (int i = 0; i < static_cast<int>(InstrumentPhase::Count); ++i) {
+        long long calls = phases[i].calls;
+        if (calls == 0) { continue; }
+        out << phaseName(static_cast<InstrumentPhase>(i)) << ": " << calls << " calls, " << seconds(phases[i].nanoseconds)
+            << " s\n";
+      }
+      long long readNs = phases[static_cast<int>(InstrumentPhase::ReadDirectory)].nanoseconds;
+      if (readNs > 0) {
+        out << "entries/sec (directory reads only): " << std::setprecision(0)
+            << static_cast<double>(directoryEntries) / seconds(readNs) << std::setprecision(6) << "\n";
+      }
+      out << "heap: " << allocations << " allocations, " << allocatedBytes << " bytes\n";
+      for (int d = 0; d < maxDepth; ++d) {
+        long long calls = depthLatency[d].calls;
+        if (calls == 0) { continue; }
+        out << "depth " << d << (d == maxDepth - 1 ? "+" : "") << ": " << calls << " directories, avg "
+            << seconds(depthLatency[d].nanoseconds) / static_cast<double>(calls) << " s\n";
+      }
+      std::lock_guard<std::mutex> guard(lock);
+      for (const SlowDirectory &slow: slowest) {
+        out << "slow: " << seconds(slow.nanoseconds) << " s, " << slow.entries << " entries, " << slow.path << "\n";
+      }
+    }
+
+    // Prometheus 텍스트 형식
+    void writePrometheus(std::ostream &out) {
+      out << "# TYPE fs_phase_calls_total counter\n";
+      for (int i = 0; i < static_cast<int>(InstrumentPhase::Count); ++i) {
+        out << "fs_phase_calls_total{phase=\"" << phaseName(static_cast<InstrumentPhase>(i)) << "\"} " << phases[i].calls << "\n";
+      }
+      out << "# TYPE fs_phase_seconds_total counter\n" << std::fixed << std::setprecision(9);
+      for (int i = 0; i < static_cast<int>(InstrumentPhase::Count); ++i) {
+        out << "fs_phase_seconds_total{phase=\"" << phaseName(static_cast<InstrumentPhase>(i)) << "\"} "
+            << static_cast<double>(phases[i].nanoseconds) / 1e9 << "\n";
+      }
+      out << "# TYPE fs_directory_reads_total counter\n";
+      for (int d = 0; d < maxDepth; ++d) {
+        if (depthLatency[d].calls == 0) { continue; }
+        out << "fs_directory_reads_total{depth=\"" << d << "\"} " << depthLatency[d].calls << "\n";
+      }
+      out << "# TYPE fs_directory_read_seconds_total counter\n";
+      for (int d = 0; d < maxDepth; ++d) {
+        if (depthLatency[d].calls == 0) { continue; }
+        out << "fs_directory_read_seconds_total{depth=\"" << d << "\"} "
+            << static_cast<double>(depthLatency[d].nanoseconds) / 1e9 << "\n";
+      }
+      out << "# TYPE fs_directory_entries_total counter\nfs_directory_entries_total " << directoryEntries << "\n";
+      out << "# TYPE fs_heap_allocations_total counter\nfs_heap_allocations_total " << allocations << "\n";
+      out << "# TYPE fs_heap_allocated_bytes_total counter\nfs_heap_allocated_bytes_total " << allocatedBytes << "\n";
+    }
+
+    // Chrome trace 형식 (chrome://tracing, Perfetto, speedscope에서 불꽃 그래프로 볼 수 있음)
+    void writeTrace(std::ostream &out) {
+      std::lock_guard<std::mutex> guard(lock);
+      out << "{\"traceEvents\":[";
+      for (size_t i = 0; i < events.size(); ++i) {
+        const TraceEvent &e = events[i];
+        out << (i ? ",\n" : "\n") << "{\"name\":\"" << phaseName(e.phase) << "\",\"ph\":\"X\",\"ts\":" << e.startUs
+            << ",\"dur\":" << e.durationUs << ",\"pid\":1,\"tid\":" << (e.thread % 1000000) << "}";
+      }
+      out << "\n]}\n";
+    }
+
+    // 구간 하나를 재는 RAII 객체
+    class PhaseScope {
+      private:
+        InstrumentPhase phase;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      public:
+        explicit PhaseScope(InstrumentPhase p): phase(p) {}
+        ~PhaseScope() { get().recordPhase(phase, start, elapsedNs(start)); }
+    };
+
+    template <typename Entries>
+    class DirectoryScope {
+      private:
+        const fs::path &path;
+        int depth;
+        const Entries &entries;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      public:
+        DirectoryScope(const fs::path &p, int d, const Entries &e): path(p), depth(d), entries(e) {}
+        ~DirectoryScope() {
+          long long ns = elapsedNs(start);
+          get().recordPhase(InstrumentPhase::ReadDirectory, start, ns);
+          get().recordDirectory(path, depth, static_cast<long long>(entries.size()), ns);
+        }
+    };
+};
+
+// 소멸할 때(main이 끝날 때) 모은 값을 stderr와 트레이스 파일로 내보냄
+class InstrumentationReport {
+  private:
+    std::string format;
+    std::string tracePath;
+  public:
+    InstrumentationReport(std::string f, std::string t): format(std::move(f)), tracePath(std::move(t)) {
+      if (!tracePath.empty()) { Instrumentation::get().enableTrace(); }
+    }
+    ~InstrumentationReport() {
+      if (format == "summary") { Instrumentation::get().writeSummary(std::cerr); }
+      if (format == "prometheus") { Instrumentation::get().writePrometheus(std::cerr); }
+      if (!tracePath.empty()) {
+        std::ofstream trace(tracePath);
+        Instrumentation::get().writeTrace(trace);
+      }
+    }
+};
+
+void *operator new(size_t bytes) {
+  Instrumentation &instrumentation = Instrumentation::get();
+  ++instrumentation.allocations;
+  instrumentation.allocatedBytes += static_cast<long long>(bytes);
+  if (void *p = std::malloc(bytes ? bytes : 1)) { return p; }
+  throw std::bad_alloc();
+}
+// 인라인되면 GCC가 new/free 짝이 안 맞는다고 잘못 경고하므로 막아 둠
+__attribute__((noinline)) void operator delete(void *p) noexcept { std::free(p); }
+__attribute__((noinline)) void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+#define FS_CONCAT_INNER(a, b) a##b
+#define FS_CONCAT(a, b) FS_CONCAT_INNER(a, b)
+#define FS_PHASE_SCOPE(phase) Instrumentation::PhaseScope FS_CONCAT(fsPhaseScope, __LINE__)(phase)
+#define FS_DIRECTORY_SCOPE(path, depth, entries) \
+  Instrumentation::DirectoryScope FS_CONCAT(fsDirectoryScope, __LINE__)(path, depth, entries)
+#else
+#define FS_PHASE_SCOPE(phase) ((void)0)
+#define FS_DIRECTORY_SCOPE(path, depth, entries) ((void)0)
+#endif
+
+// 트리 하나가 통째로 소유하는 메모리 영역
+// 노드와 자식 배열은 덩어리 단위로 잘라 쓰고(bump 할당), 이름은 중복 없이 한 번만 저장(intern)한다
+// 개별 해제는 하지 않으며 arena가 소멸할 때 한 번에 반납됨 (노드 소멸자도 호출되지 않음)
+// 병렬 스캐너가 같이 쓸 수 있도록 할당은 잠금으로 보호함
+class TreeArena : public std::pmr::memory_resource {
+  private:
+    std::pmr::monotonic_buffer_resource buffer{64 * 1024};
+    std::unordered_set<std::string_view> names;
+    std::mutex lock;
+
+    void *do_allocate(size_t bytes, size_t alignment) override {
+      std::lock_guard<std::mutex> guard(lock);
+      return buffer.allocate(bytes, alignment);
+    }
+    void do_deallocate(void *, size_t, size_t) override {}
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override { return this == &other; }
+
+  public:
+    TreeArena() = default;
+    TreeArena(const TreeArena &) = delete;
+    TreeArena &operator=(const TreeArena &) = delete;
+
+    // 같은 이름은 같은 저장소를 가리키게 해서 반환
+    std::string_view intern(std::string_view s) {
+      std::lock_guard<std::mutex> guard(lock);
+      auto found = names.find(s);
+      if (found != names.end()) { return *found; }
+      char *copy = static_cast<char *>(buffer.allocate(s.size() + 1, 1));
+      s.copy(copy, s.size());
+      copy[s.size()] = '\0';
+      return *names.insert(std::string_view(copy, s.size())).first;
+    }
+
+    // arena 안에 노드 생성. T는 (TreeArena &, ...) 생성자를 가져야 함
+    template <typename T, typename... Args>
+    T *make(Args &&...args) {
+      void *memory = allocate(sizeof(T), alignof(T));
+      return new (memory) T(*this, std::forward<Args>(args)...);
+    }
+};
+
+// 스냅샷과 화면 출력의 십진수 변환 (크기, 자식 수)
+// 쓰기는 자릿수를 먼저 구해 두 자리씩 표에서 뒤에서부터 채우고,
+// 읽기는 8바이트를 한 번에 읽어 숫자인 바이트 수를 구한 뒤 곱셈 세 번으로 8자리까지 한꺼번에 바꿈 (SWAR)
+// 16자리를 넘거나 입력 끝 근처라서 8바이트씩 읽을 수 없으면 std::from_chars로 읽음 (범위 검사도 그쪽이 함)
+namespace decimal {
+
+constexpr size_t maxLength = 20;  // "-9223372036854775808"
+
+inline const uint64_t *powersOf10() {
+  static const uint64_t table[20] = {1ULL,
+                                     10ULL,
+                                     100ULL,
+                                     1000ULL,
+                                     10000ULL,
+                                     100000ULL,
+                                     1000000ULL,
+                                     10000000ULL,
+                                     100000000ULL,
+                                     1000000000ULL,
+                                     10000000000ULL,
+                                     100000000000ULL,
+                                     1000000000000ULL,
+                                     10000000000000ULL,
+                                     100000000000000ULL,
+                                     1000000000000000ULL,
+                                     10000000000000000ULL,
+                                     100000000000000000ULL,
+                                     1000000000000000000ULL,
+                                     10000000000000000000ULL};
+  return table;
+}
+
+inline int digitCount(uint64_t value) {
+  // log10 ~= log2 * 1233 / 4096에서 한 자리 모자랄 수 있는 것만 표로 보정 (0은 1과 같이 한 자리)
+  value |= 1;
+  int bits = 64 - __builtin_clzll(value);
+  int guess = (bits * 1233) >> 12;
+  return guess + (value >= powersOf10()[guess] ? 1 : 0);
+}
+
+// out에 value를 쓰고 끝 위치를 반환 (out에 maxLength바이트 자리가 있어야 함)
+inline char *format(char *out, long long value) {
+  static const char pairs[] =
+      "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+      "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+      "8081828384858687888990919293949596979899";
+  uint64_t magnitude = static_cast<uint64_t>(value);
+  if (value < 0) {
+    *out++ = '-';
+    magnitude = 0 - magnitude;
+  }
+  char *end = out + digitCount(magnitude);
+  char *p = end;
+  while (magnitude >= 100) {
+    unsigned rest = static_cast<unsigned>(magnitude % 100);
+    magnitude /= 100;
+    p -= 2;
+    std::memcpy(p, pairs + rest * 2, 2);
+  }
+  if (magnitude >= 10) {
+    std::memcpy(p - 2, pairs + magnitude * 2, 2);
+  } else {
+    p[-1] = static_cast<char>('0' + magnitude);
+  }
+  return end;
+}
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+// p부터 8바이트 중 앞쪽의 숫자 바이트 수(length)와 그 값
+inline uint64_t parseChunk(const char *p, int &length) {
+  uint64_t chunk;
+  std::memcpy(&chunk, p, sizeof(chunk));
+  uint64_t digits = chunk - 0x3030303030303030ULL;
+  // '0'보다 작으면 빼기에서, '9'보다 크면 0x76을 더할 때 바이트의 최상위 비트가 켜짐
+  uint64_t nonDigit = (digits | (digits + 0x7676767676767676ULL)) & 0x8080808080808080ULL;
+  length = nonDigit ? __builtin_ctzll(nonDigit) >> 3 : 8;
+  if (length == 0) { return 0; }
+  // 숫자가 아닌 뒤쪽 바이트를 밀어내면 앞에 0이 채워진 8자리 수가 됨
+  digits <<= (8 - length) * 8;
+  digits = (digits * 10 + (digits >> 8)) & 0x00ff00ff00ff00ffULL;
+  digits = (digits * 100 + (digits >> 16)) & 0x0000ffff0000ffffULL;
+  return (digits * 10000 + (digits >> 32)) & 0xffffffffULL;
+}
+#endif
+
+// [p, end)의 앞에서 음이 아닌 십진수를 읽어 value에 넣고 다음 위치를 반환 (숫자가 없거나 범위를 넘으면 nullptr)
+inline const char *parse(const char *p, const char *end, long long &value) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  if (end - p >= 16) {
+    int first;
+    uint64_t high = parseChunk(p, first);
+    if (first == 0) { return nullptr; }
+    if (first < 8) {
+      value = static_cast<long long>(high);
+      return p + first;
+    }
+    int second;
+    uint64_t low = parseChunk(p + 8, second);
+    if (second < 8) {
+      value = static_cast<long long>(high * powersOf10()[second] + low);
+      return p + 8 + second;
+    }
+  }
+#endif
+  if (p == end || static_cast<unsigned char>(*p - '0') > 9) { return nullptr; }
+  auto [next, err] = std::from_chars(p, end, value);
+  return err == std::errc() ? next : nullptr;
+}
+
+}  // namespace decimal
+
+// serialize() 등이 결과를 써 넣는 출력 대상
+// 내부 버퍼에 모았다가 flushThreshold를 넘으면 drain()으로 내보냄 (문자열 sink는 끝까지 모아 둠)
+class OutputSink {
+  protected:
+    std::string buffer;
+    size_t flushThreshold;
+
+    // 버퍼 내용을 실제 출력 대상으로 보내고 버퍼를 비움
+    virtual void drain() {}
+
+  public:
+    explicit OutputSink(size_t threshold = SIZE_MAX): flushThreshold(threshold) {
+      if (threshold != SIZE_MAX) { buffer.reserve(threshold); }
+    }
+    OutputSink(const OutputSink &) = delete;
+    OutputSink &operator=(const OutputSink &) = delete;
+    virtual ~OutputSink() = default;
+
+    void write(std::string_view s) {
+      buffer.append(s.data(), s.size());
+      if (buffer.size() >= flushThreshold) { drain(); }
+    }
+    void put(char c) {
+      buffer.push_back(c);
+      if (buffer.size() >= flushThreshold) { drain(); }
+    }
+    void writeNumber(long long value) {
+      char digits[decimal::maxLength];
+      write(std::string_view(digits, static_cast<size_t>(decimal::format(digits, value) - digits)));
+    }
+    void flush() { drain(); }
+};
+
+// 메모리에 계속 늘려 가며 모으는 sink
+class StringSink : public OutputSink {
+  public:
+    std::string take() { return std::move(buffer); }
+    const std::string &str() const { return buffer; }
+};
+
+// 내용은 버리고 바이트 수만 세는 sink (벤치마크용)
+class CountingSink : public OutputSink {
+  private:
+    long long count = 0;
+  protected:
+    void drain() override {
+      count += static_cast<long long>(buffer.size());
+      buffer.clear();
+    }
+  public:
+    CountingSink(): OutputSink(64 * 1024) {}
+    long long getCount() const { return count; }
+};
+
+// std::ostream으로 내보내는 sink
+class StreamSink : public OutputSink {
+  private:
+    std::ostream &out;
+  protected:
+    void drain() override {
+      out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+      buffer.clear();
+    }
+  public:
+    explicit StreamSink(std::ostream &o, size_t threshold = 64 * 1024): OutputSink(threshold), out(o) {}
+    ~StreamSink() override { drain(); }
+};
+
+#if defined(__unix__) || defined(__APPLE__)
+// 파일 디스크립터로 바로 write() 하는 sink (fd는 호출한 쪽이 닫음)
+class FdSink : public OutputSink {
+  private:
+    int fd;
+  protected:
+    void drain() override {
+      size_t written = 0;
+      while (written < buffer.size()) {
+        ssize_t n = ::write(fd, buffer.data() + written, buffer.size() - written);
+        if (n < 0) {
+          if (errno == EINTR) { continue; }
+          throw std::system_error(errno, std::generic_category(), "write");
+        }
+        written += static_cast<size_t>(n);
+      }
+      buffer.clear();
+    }
+  public:
+    explicit FdSink(int f, size_t threshold = 64 * 1024): OutputSink(threshold), fd(f) {}
+    ~FdSink() override {
+      try { drain(); } catch (...) {}
+    }
+};
+#endif
+
+// display()의 한 줄 형식 (들여쓰기는 단계마다 공백 2칸)
+// 루트 "."은 기존 출력 그대로 "./ (total<크기>bytes)"로 씀
+void writeDisplayLine(OutputSink &sink, int indent, std::string_view name, long long size, bool isDirectory) {
+  static const std::string spaces(256, ' ');
+  for (size_t remaining = static_cast<size_t>(indent) * 2; remaining > 0;) {
+    size_t chunk = std::min(remaining, spaces.size());
+    sink.write(std::string_view(spaces.data(), chunk));
+    remaining -= chunk;
+  }
+  sink.write(name);
+  if (!isDirectory) {
+    sink.write(" (");
+    sink.writeNumber(size);
+    sink.write(" bytes)\n");
+  } else if (name == ".") {
+    sink.write("/ (total");
+    sink.writeNumber(size);
+    sink.write("bytes)\n");
+  } else {
+    sink.write("/ (total ");
+    sink.writeNumber(size);
+    sink.write(" bytes)\n");
+  }
+}
+
+// 디렉터리가 바뀌었는지 판단하는 값. 기록이 없으면 valid == false
+struct DirectoryStamp {
+  long long mtimeNs = 0;
+  unsigned long long inode = 0;
+  unsigned long long device = 0;
+  bool valid = false;
+
+  bool operator==(const DirectoryStamp &other) const {
+    return valid == other.valid && mtimeNs == other.mtimeNs && inode == other.inode && device == other.device;
+  }
+  bool operator!=(const DirectoryStamp &other) const { return !(*this == other); }
+};
+
 class FilesystemComponent {
+  friend class Directory;
   protected:
-    std::string name;
+    std::string ownedName;      // 힙 노드의 이름 저장소 (arena 노드는 비어 있음)
+    std::string_view name;      // ownedName 또는 arena에 intern된 이름
+    TreeArena *arena = nullptr; // 이 노드를 소유한 arena (힙 노드면 nullptr)
+    // 상위 디렉터리 (크기 변경을 위로 전파할 때 사용, 루트는 nullptr)
+    Directory *parent = nullptr;
+
+    // 이름만 바꿈 (부모의 색인은 setName()이 맞춰 줌)
+    void assignName(std::string_view n) {
+      if (arena) {
+        name = arena->intern(n);
+      } else {
+        ownedName.assign(n);
+        name = ownedName;
+      }
+    }
+
+  public:
+    FilesystemComponent(std::string n): ownedName(std::move(n)), name(ownedName) {}
+    FilesystemComponent(TreeArena &a, std::string_view n): name(a.intern(n)), arena(&a) {}
+    // name이 자기 저장소를 가리키므로 복사 금지
+    FilesystemComponent(const FilesystemComponent &) = delete;
+    FilesystemComponent &operator=(const FilesystemComponent &) = delete;
+    virtual ~FilesystemComponent() = default;
+    // 이름과 크기 출력. sink 버퍼에 모아서 쓰고 끝에서 한 번만 내보냄 (줄마다 flush 하지 않음)
+    virtual void display(OutputSink &sink, int indent = 0) const = 0;
+    void display(std::ostream &out, int indent = 0) const {
+      StreamSink sink(out);
+      display(sink, indent);
+    }
+    void display(int indent = 0) const { display(std::cout, indent); }
+    virtual long long getSize() const = 0;
+    virtual std::string getName() const { return std::string(name); }
+    std::string_view getNameView() const { return name; }
+    Directory *getParent() const { return parent; }
+    bool isArenaOwned() const { return arena != nullptr; }
+    // 이름 변경. 부모가 있으면 부모의 자식 색인과 경로 색인도 함께 갱신됨
+    void setName(std::string_view n);
+
+    // 하위 트리에 포함된 파일 수 / 디렉터리 수 (자기 자신 제외)
+    virtual long long getFileCount() const = 0;
+    virtual long long getDirectoryCount() const = 0;
+    virtual bool isDirectory() const = 0;
+
+    // 과제2
+    // sink에 직접 이어 쓰기 (각 노드는 한 번씩만 써짐)
+    virtual void serialize(OutputSink &sink) const = 0;
+    std::string serialize() const {
+      StringSink sink;
+      serialize(sink);
+      return sink.take();
+    }
+    virtual void deserialize(std::string_view data) = 0;
+};
+
+// 노드의 소유 방식에 맞춰 해제 (arena 노드는 arena가 해제하므로 아무것도 안 함)
+struct ComponentDeleter {
+  void operator()(FilesystemComponent *component) const {
+    if (component && !component->isArenaOwned()) { delete component; }
+  }
+};
+using ComponentPtr = std::unique_ptr<FilesystemComponent, ComponentDeleter>;
+// Directory::createFile()/createDirectory()가 돌려주는 타입을 아는 소유 포인터 (ComponentPtr로 바로 옮겨짐)
+class File;
+class Directory;
+using FilePtr = std::unique_ptr<File, ComponentDeleter>;
+using DirectoryPtr = std::unique_ptr<Directory, ComponentDeleter>;
+
+// 자식이 많은 디렉터리에서 이름으로 자식을 O(1)에 찾는 open addressing 해시 (선형 탐사)
+// 출력 순서인 children은 그대로 두고 옆에 따로 유지함
+class ChildIndex {
+  private:
+    std::pmr::vector<FilesystemComponent *> slots;  // nullptr는 빈 칸, tombstone()은 지워진 칸
+    size_t live = 0;
+    size_t occupied = 0;  // live + 지워진 칸
+
+    static FilesystemComponent *tombstone() { return reinterpret_cast<FilesystemComponent *>(uintptr_t(1)); }
+    static size_t hashOf(std::string_view s) { return std::hash<std::string_view>()(s); }
+
+    void rehash(size_t capacity) {
+      std::pmr::vector<FilesystemComponent *> old(capacity, nullptr, slots.get_allocator());
+      old.swap(slots);
+      live = 0;
+      occupied = 0;
+      for (FilesystemComponent *c: old) {
+        if (c && c != tombstone()) { insert(c); }
+      }
+    }
+
+  public:
+    ChildIndex() = default;
+    explicit ChildIndex(std::pmr::memory_resource *resource): slots(resource) {}
+
+    bool active() const { return !slots.empty(); }
+
+    // n개를 넣어도 다시 늘리지 않도록 한 번에 잡아 둠 (비어 있을 때만)
+    void reserve(size_t n) {
+      if (live > 0) { return; }
+      size_t capacity = 16;
+      while (capacity * 3 < (n + 1) * 4) { capacity *= 2; }
+      rehash(capacity);
+    }
+
+    void clear() {
+      slots.clear();
+      slots.shrink_to_fit();
+      live = 0;
+      occupied = 0;
+    }
+
+    void insert(FilesystemComponent *component) {
+      if ((occupied + 1) * 4 > slots.size() * 3) {
+        // 크기는 2의 거듭제곱으로 유지 (탐사에 mask를 씀)
+        size_t capacity = 16;
+        while (capacity < (live + 1) * 2) { capacity *= 2; }
+        rehash(capacity);
+      }
+      size_t mask = slots.size() - 1;
+      for (size_t i = hashOf(component->getNameView()) & mask;; i = (i + 1) & mask) {
+        if (!slots[i] || slots[i] == tombstone()) {
+          if (!slots[i]) { ++occupied; }
+          slots[i] = component;
+          ++live;
+          return;
+        }
+      }
+    }
+
+    void erase(FilesystemComponent *component) {
+      if (slots.empty()) { return; }
+      size_t mask = slots.size() - 1;
+      for (size_t i = hashOf(component->getNameView()) & mask; slots[i]; i = (i + 1) & mask) {
+        if (slots[i] == component) {
+          slots[i] = tombstone();
+          --live;
+          return;
+        }
+      }
+    }
+
+    FilesystemComponent *find(std::string_view childName) const {
+      if (slots.empty()) { return nullptr; }
+      size_t mask = slots.size() - 1;
+      for (size_t i = hashOf(childName) & mask; slots[i]; i = (i + 1) & mask) {
+        if (slots[i] != tombstone() && slots[i]->getNameView() == childName) { return slots[i]; }
+      }
+      return nullptr;
+    }
+};
+
+// 지연 펼침 디렉터리(Directory::setLazy())의 자식을 처음 필요할 때 만들어 주는 쪽
+// 트리보다 오래 살아 있어야 함
+class LazyChildSource {
+  public:
+    virtual ~LazyChildSource() = default;
+    // token이 가리키는 디렉터리의 자식을 dir과 같은 소유 방식으로 만들어 반환 (하위 디렉터리는 다시 지연 상태여도 됨)
+    // 반환한 노드의 합계는 setLazy()에 넘겼던 합계와 맞아야 함. 도중에 예외가 나면 이미 만든 노드는 반환값과 함께 해제됨
+    virtual std::vector<ComponentPtr> loadChildren(Directory &dir, uint64_t token) = 0;
+};
+
+// File/Directory는 더 파생되지 않으므로(final) 구체 타입으로 부르면 가상 호출 없이 인라인됨 (foldTree()가 이용)
+class File final : public FilesystemComponent {
+  private:
+    long long size;
+  public:
+    File(std::string n, long long s): FilesystemComponent(std::move(n)), size(s) {}
+    File(TreeArena &a, std::string_view n, long long s): FilesystemComponent(a, n), size(s) {}
+    // 이름과 크기 출력 (override 함)
+    using FilesystemComponent::display;
+    void display(OutputSink &sink, int indent = 0) const override {
+      writeDisplayLine(sink, indent, name, size, false);
+    }
+
+    long long getSize() const override { return size; }
+    long long getFileCount() const override { return 1; }
+    long long getDirectoryCount() const override { return 0; }
+    bool isDirectory() const override { return false; }
+
+    // 크기를 바꾸고 그 차이를 상위 디렉터리들의 합계에 반영
+    void setSize(long long s);
+
+    // 과제2
+    using FilesystemComponent::serialize;
+    void serialize(OutputSink &sink) const override {
+      sink.write("F|");
+      sink.write(name);
+      sink.put('|');
+      sink.writeNumber(size);
+    }
+
+    void deserialize(std::string_view data) override;
+};
+
+class PathIndex;
+
+class Directory final : public FilesystemComponent {
+  private:
+    // 자식이 이보다 많아지면 이름 검색용 해시 색인을 만듦
+    static constexpr size_t childIndexThreshold = 8;
+
+    std::pmr::vector<FilesystemComponent *> children;
+    ChildIndex childIndex;
+    // 루트에서 enablePathIndex()를 호출했을 때만 생기는 전역 경로 색인
+    std::unique_ptr<PathIndex> pathIndex;
+    // 하위 트리 전체의 집계값 캐시 (add() 등에서 갱신되므로 getSize()는 O(1))
+    long long totalSize = 0;
+    long long fileCount = 0;
+    long long dirCount = 0;
+    // 마지막으로 읽었을 때의 stamp (증분 스캔용)
+    DirectoryStamp stamp;
+    // 하위 트리 내용(이름, 크기, 구조)의 해시 캐시. 구조나 크기가 바뀌면 루트까지 무효화됨
+    mutable uint64_t contentHash = 0;
+    mutable bool contentHashValid = false;
+    // 해시 캐시를 버릴 때마다 새로 받는 번호. 모든 디렉터리에 걸쳐 겹치지 않으므로 해제된 노드의 주소가 다시 쓰여도 구별됨
+    uint64_t revision = nextRevision();
+    // 지연 상태면 자식을 만들어 줄 곳 (펼친 뒤에는 nullptr)
+    LazyChildSource *lazySource = nullptr;
+    uint64_t lazyToken = 0;
+    // 깊이 제한으로 접혀서 자식 없이 합계만 가진 디렉터리
+    bool collapsed = false;
+
+    static uint64_t nextRevision() {
+      static std::atomic<uint64_t> counter{0};
+      return counter.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+    // 이 노드가 속한 트리의 경로 색인 (없으면 nullptr)
+    PathIndex *findPathIndex();
+    // lazySource에서 자식을 만들어 붙임 (합계는 이미 맞으므로 전파하지 않음)
+    void loadLazyChildren();
+  public:
+    Directory(std::string n): FilesystemComponent(std::move(n)) {}
+    Directory(TreeArena &a, std::string_view n): FilesystemComponent(a, n), children(&a), childIndex(&a) {}
+    ~Directory() override;
+
+    // 이 디렉터리와 같은 방식(힙 또는 같은 arena)으로 소유되는 새 노드 생성 (아직 추가되지 않은 상태)
+    FilePtr createFile(std::string_view n, long long s) {
+      return FilePtr(arena ? arena->make<File>(n, s) : new File(std::string(n), s));
+    }
+    DirectoryPtr createDirectory(std::string_view n) {
+      return DirectoryPtr(arena ? arena->make<Directory>(n) : new Directory(std::string(n)));
+    }
+    // 이름 문자열을 이미 갖고 있으면 힙 노드에는 복사 없이 옮겨 넣음 (arena 노드는 intern)
+    FilePtr createFile(std::string &&n, long long s) {
+      return FilePtr(arena ? arena->make<File>(std::string_view(n), s) : new File(std::move(n), s));
+    }
+    DirectoryPtr createDirectory(std::string &&n) {
+      return DirectoryPtr(arena ? arena->make<Directory>(std::string_view(n)) : new Directory(std::move(n)));
+    }
+    FilePtr createFile(const char *n, long long s) { return createFile(std::string_view(n), s); }
+    DirectoryPtr createDirectory(const char *n) { return createDirectory(std::string_view(n)); }
+
+    // 자식이 n개가 될 것을 알 때 미리 자리를 잡아 둠 (arena 디렉터리는 늘리면서 버리는 배열이 생기지 않음)
+    void reserve(size_t n);
+
+    // 이 디렉터리에 파일, 하위 디렉터리 추가 (소유권을 넘겨받음)
+    // arena 디렉터리에는 같은 arena에서 만든 노드만 추가해야 함
+    void add(ComponentPtr component);
+
+    // 이름이 같은 자식 (없으면 nullptr). 자식이 많으면 해시 색인으로 O(1)
+    FilesystemComponent *findChild(std::string_view childName) const;
+
+    // 자식 하나를 떼어 내서 반환 (합계도 그만큼 줄어듦). 자식이 아니면 nullptr
+    ComponentPtr remove(FilesystemComponent *component);
+
+    // 자식을 모두 떼어 내서 반환 (합계도 그만큼 줄어듦)
+    std::vector<ComponentPtr> takeChildren();
+
+    // child의 이름을 바꾸고 색인을 맞춤 (FilesystemComponent::setName()이 사용)
+    void renameChild(FilesystemComponent *child, std::string_view newName);
+
+    // 이 디렉터리를 루트로 하는 전역 경로 색인을 켜고 끔
+    void enablePathIndex();
+    void disablePathIndex();
+    // 이 디렉터리 기준 경로("a/b/c")로 노드 찾기. 경로 색인이 켜져 있으면 O(1)
+    FilesystemComponent *find(std::string_view path);
+    // 경로의 크기. 없는 경로면 nullopt
+    using FilesystemComponent::getSize;
+    std::optional<long long> getSize(std::string_view path);
+
+    const DirectoryStamp &getStamp() const { return stamp; }
+    void setStamp(const DirectoryStamp &s) { stamp = s; }
+
+    // 자식들의 캐시 값으로 이 디렉터리의 집계값만 다시 계산 (자식은 이미 맞다고 가정, 부모로 전파하지 않음)
+    void recomputeLocalTotals() {
+      if (lazySource || collapsed) { return; }  // 펼치지 않았거나 접혔으면 미리 받은 합계가 그대로 맞음
+      invalidateContentHash();
+      totalSize = fileCount = dirCount = 0;
+      for (FilesystemComponent *child: children) {
+        totalSize += child->getSize();
+        fileCount += child->getFileCount();
+        dirCount += child->getDirectoryCount() + (child->isDirectory() ? 1 : 0);
+      }
+    }
+    // 하위 트리 전체의 집계값을 파일 크기로부터 다시 계산 (getChildren()으로 구조를 직접 바꾼 뒤 등, 루트에서 호출)
+    void recomputeTotals();
+
+    // 하위 트리 내용 해시 (자기 이름은 들어가지 않고, 자식 순서와도 무관함)
+    // 캐시가 없는 부분만 다시 계산하므로 바뀌지 않은 트리에서는 O(1). 여러 스레드에서 동시에 부르면 안 됨
+    uint64_t getContentHash() const;
+    // 이 디렉터리부터 루트까지 해시 캐시를 버림 (버린 디렉터리는 revision도 바뀜)
+    // 캐시가 없는 디렉터리의 조상은 모두 캐시가 없다는 불변식 덕분에 이미 버린 곳에서 멈춰도 됨
+    void invalidateContentHash() {
+      for (Directory *dir = this; dir && dir->contentHashValid; dir = dir->parent) {
+        dir->contentHashValid = false;
+        dir->revision = nextRevision();
+      }
+    }
+    // 하위 트리의 이름, 크기, 구조, 자식 순서가 그대로이면 같은 값 (getContentHash()를 부른 뒤로 바뀐 것이 없을 때)
+    uint64_t getRevision() const { return revision; }
+
+    // 집계값 변화량을 이 디렉터리부터 루트까지 반영
+    void propagate(long long sizeDelta, long long fileDelta, long long dirDelta) {
+      invalidateContentHash();
+      for (Directory *dir = this; dir; dir = dir->parent) {
+        dir->totalSize += sizeDelta;
+        dir->fileCount += fileDelta;
+        dir->dirCount += dirDelta;
+      }
+    }
+
+    long long getSize() const override { return totalSize; }
+    long long getFileCount() const override { return fileCount; }
+    long long getDirectoryCount() const override { return dirCount; }
+    bool isDirectory() const override { return true; }
+    // 디렉터리 이름과 디렉터리에 포함된 모든 파일의 크기 합
+    using FilesystemComponent::display;
+    void display(OutputSink &sink, int indent = 0) const override;
+    // 외부에서 자식 목록에 접근해야 할 경우 사용하는 함수. 목록은 읽기 전용이고 바꿀 때는 add()/remove()/takeChildren()을 씀
+    // (자식 노드 자체는 고칠 수 있음). 지연 상태인 디렉터리는 여기서 처음 자식을 만듦
+    const std::pmr::vector<FilesystemComponent *> &getChildren() const {
+      ensureLoaded();
+      return children;
+    }
+
+    // 지연 펼침: 자식은 처음 getChildren()/findChild()/add() 등이 필요로 할 때 source에서 만들고,
+    // 그 전에는 미리 알려 준 합계로 getSize()/getFileCount()/getDirectoryCount()에 답함 (자식이 없는 디렉터리에만 사용)
+    // 펼치는 일은 const 메서드 안에서도 일어나므로 지연 트리는 한 스레드에서만 다뤄야 함
+    // 경로 색인을 켜면 색인을 만들면서 전부 펼쳐짐
+    void setLazy(LazyChildSource *source, uint64_t token, long long size, long long files, long long dirs) {
+      lazySource = source;
+      lazyToken = token;
+      propagate(size - totalSize, files - fileCount, dirs - dirCount);
+    }
+    bool isLoaded() const { return lazySource == nullptr; }
+
+    // 깊이 제한 스캔에서 하위 트리를 노드로 만들지 않고 합계만 둠 (자식이 없는 디렉터리에만 사용하고 이후 자식을 추가하지 않음)
+    // 텍스트 스냅샷에는 C 레코드로 합계가 남음. 바이너리/압축 스냅샷에는 둘 곳이 없어서 쓰지 않음 (runtime_error)
+    void setCollapsed(long long size, long long files, long long dirs) {
+      collapsed = true;
+      propagate(size - totalSize, files - fileCount, dirs - dirCount);
+    }
+    bool isCollapsed() const { return collapsed; }
+    void ensureLoaded() const {
+      if (lazySource) { const_cast<Directory *>(this)->loadLazyChildren(); }
+    }
+
+    // 과제2
+    using FilesystemComponent::serialize;
+    // 모든 자식들을 같은 sink에 이어 씀
+    void serialize(OutputSink &sink) const override;
+
+    void deserialize(std::string_view data) override;
+};
+
+// 재귀 호출 없이 트리를 도는 공용 순회 함수. 깊이는 힙에 둔 명시적 스택으로만 제한됨
+//   enter(node, depth): 노드를 처음 만날 때 (전위). 디렉터리에서 false를 반환하면 그 하위는 건너뜀
+//   leave(dir, depth): 디렉터리의 자식을 다 돈 뒤 (후위, enter가 true였던 디렉터리만)
+// Node가 const이면 const 트리로 순회함
+template <typename Node, typename Enter, typename Leave>
+void traverseTree(Node &root, Enter &&enter, Leave &&leave) {
+  using Base = std::conditional_t<std::is_const_v<Node>, const FilesystemComponent, FilesystemComponent>;
+  using Dir = std::conditional_t<std::is_const_v<Node>, const Directory, Directory>;
+  struct Frame {
+    Dir *dir;
+    size_t next;
+  };
+
+  if (!enter(root, 0) || !root.isDirectory()) { return; }
+  std::vector<Frame> stack;
+  stack.push_back({static_cast<Dir *>(&root), 0});
+  while (!stack.empty()) {
+    Frame &top = stack.back();
+    auto &children = top.dir->getChildren();
+    if (top.next == children.size()) {
+      Dir *done = top.dir;
+      stack.pop_back();
+      leave(*done, static_cast<int>(stack.size()));
+      continue;
+    }
+    Base *child = children[top.next++];
+    if (enter(*child, static_cast<int>(stack.size())) && child->isDirectory()) {
+      stack.push_back({static_cast<Dir *>(child), 0});
+    }
+  }
+}
+
+template <typename Node, typename Enter>
+void traverseTree(Node &root, Enter &&enter) {
+  traverseTree(root, std::forward<Enter>(enter), [](auto &, int) {});
+}
+
+// foldTree()에 넘기는 연산의 기본형. 필요한 것만 같은 이름으로 다시 정의하면 됨 (가상 함수가 아님)
+//   file(file, depth): 파일마다, enter(dir, depth): 디렉터리를 처음 만날 때(전위), leave(dir, depth): 자식을 다 돈 뒤(후위)
+struct TreeFold {
+  void file(const File &, int) {}
+  void enter(const Directory &, int) {}
+  void leave(const Directory &, int) {}
+};
+
+// 여러 연산을 한 번의 순회로 합쳐서 돌림 (예: 직렬화하면서 개수와 해시도 계산)
+// 노드 종류는 isDirectory() 한 번으로 가르고, 연산 호출은 컴파일할 때 펼쳐지므로 가상 호출 없이 인라인됨
+// 연산은 넘긴 순서대로 불림. 순회 중에 트리를 바꾸면 안 됨
+template <typename... Ops>
+void foldTree(const Directory &root, Ops &...ops) {
+  traverseTree(root,
+               [&ops...](const FilesystemComponent &node, int depth) {
+                 if (node.isDirectory()) {
+                   (ops.enter(static_cast<const Directory &>(node), depth), ...);
+                 } else {
+                   (ops.file(static_cast<const File &>(node), depth), ...);
+                 }
+                 return true;
+               },
+               [&ops...](const Directory &dir, int depth) { (ops.leave(dir, depth), ...); });
+}
+
+// display()와 같은 출력
+struct DisplayFold : TreeFold {
+  OutputSink &sink;
+  int indent;
+  explicit DisplayFold(OutputSink &s, int i = 0): sink(s), indent(i) {}
+  void file(const File &node, int depth) { writeDisplayLine(sink, indent + depth, node.getNameView(), node.getSize(), false); }
+  void enter(const Directory &dir, int depth) { writeDisplayLine(sink, indent + depth, dir.getNameView(), dir.getSize(), true); }
+};
+
+// serialize()와 같은 출력
+struct SerializeFold : TreeFold {
+  OutputSink &sink;
+  explicit SerializeFold(OutputSink &s): sink(s) {}
+  void file(const File &node, int) {
+    sink.write("F|");
+    sink.write(node.getNameView());
+    sink.put('|');
+    sink.writeNumber(node.getSize());
+  }
+  void enter(const Directory &dir, int) {
+    if (dir.isCollapsed()) {
+      // 접힌 디렉터리는 자식 대신 합계를 씀: C|name|size|files|dirs
+      sink.write("C|");
+      sink.write(dir.getNameView());
+      sink.put('|');
+      sink.writeNumber(dir.getSize());
+      sink.put('|');
+      sink.writeNumber(dir.getFileCount());
+      sink.put('|');
+      sink.writeNumber(dir.getDirectoryCount());
+      return;
+    }
+    sink.write("D|");
+    sink.write(dir.getNameView());
+    sink.put('|');
+    sink.writeNumber(static_cast<long long>(dir.getChildren().size()));
+    sink.put('[');
+  }
+  void leave(const Directory &dir, int) {
+    if (!dir.isCollapsed()) { sink.put(']'); }
+  }
+};
+
+// 파일 크기로부터 다시 센 합계 (캐시를 믿지 않고 검사할 때 등). 디렉터리 수에 루트는 들어가지 않음
+struct CountFold : TreeFold {
+  long long size = 0;
+  long long files = 0;
+  long long dirs = 0;
+  void file(const File &node, int) {
+    size += node.getSize();
+    ++files;
+  }
+  void enter(const Directory &, int depth) { dirs += depth > 0 ? 1 : 0; }
+};
+
+// 경로를 "a/b/c" 꼴로 정리 (앞뒤의 '/', 빈 칸, "." 구성 요소 제거)
+std::string normalizeTreePath(std::string_view path) {
+  std::string result;
+  size_t pos = 0;
+  while (pos <= path.size()) {
+    size_t end = path.find('/', pos);
+    if (end == std::string_view::npos) { end = path.size(); }
+    std::string_view part = path.substr(pos, end - pos);
+    if (!part.empty() && part != ".") {
+      if (!result.empty()) { result.push_back('/'); }
+      result.append(part.data(), part.size());
+    }
+    pos = end + 1;
+  }
+  return result;
+}
+
+// 루트 기준 경로("a/b/c")로 아무 노드나 O(1)에 찾는 전역 색인
+// Directory::enablePathIndex()로 루트에서 켜면 add()/remove()/이름 변경/deserialize()와 함께 갱신됨
+class PathIndex {
+  private:
+    const Directory &root;
+    std::unordered_map<std::string, FilesystemComponent *> nodes;
+
+    // top 하위 트리의 노드마다 visit(경로, 노드) 호출
+    template <typename Visit>
+    void forEachPath(FilesystemComponent &top, Visit &&visit) {
+      std::vector<std::string_view> names;
+      for (const FilesystemComponent *node = &top; node && node != &root; node = node->getParent()) {
+        names.push_back(node->getNameView());
+      }
+      std::string base;
+      for (auto it = names.rbegin(); it != names.rend(); ++it) {
+        if (!base.empty()) { base.push_back('/'); }
+        base.append(it->data(), it->size());
+      }
+
+      std::vector<std::string> dirPaths;  // 깊이별 디렉터리 경로
+      traverseTree(top, [&](FilesystemComponent &node, int depth) {
+        std::string path;
+        if (depth == 0) {
+          path = base;
+        } else {
+          path = dirPaths[depth - 1];
+          if (!path.empty()) { path.push_back('/'); }
+          path.append(node.getNameView().data(), node.getNameView().size());
+        }
+        if (node.isDirectory()) {
+          if (dirPaths.size() <= static_cast<size_t>(depth)) { dirPaths.resize(depth + 1); }
+          dirPaths[depth] = path;
+        }
+        visit(std::move(path), node);
+        return true;
+      });
+    }
+
+  public:
+    explicit PathIndex(const Directory &r): root(r) {}
+
+    void insertSubtree(FilesystemComponent &top) {
+      forEachPath(top, [this](std::string &&path, FilesystemComponent &node) { nodes[std::move(path)] = &node; });
+    }
+    void eraseSubtree(FilesystemComponent &top) {
+      forEachPath(top, [this](std::string &&path, FilesystemComponent &) { nodes.erase(path); });
+    }
+
+    // 정리된 경로로 찾기. 루트 자신은 ""
+    FilesystemComponent *find(const std::string &normalizedPath) const {
+      auto found = nodes.find(normalizedPath);
+      return found != nodes.end() ? found->second : nullptr;
+    }
+    size_t size() const { return nodes.size(); }
+};
+
+// 자식을 후위 순서로 지우므로 하위 디렉터리의 소멸자는 항상 빈 디렉터리를 만남
+Directory::~Directory() {
+  pathIndex.reset();
+  if (arena) { return; }
+  // 펼치지 않은 디렉터리는 지울 자식도 없으므로 순회하면서 펼치지 않게 함
+  traverseTree(*this,
+               [](FilesystemComponent &node, int) {
+                 if (node.isDirectory()) { static_cast<Directory &>(node).lazySource = nullptr; }
+                 return true;
+               },
+               [](Directory &dir, int) {
+                 for (FilesystemComponent *child: dir.children) { delete child; }
+                 dir.children.clear();
+               });
+}
+
+PathIndex *Directory::findPathIndex() {
+  Directory *top = this;
+  while (top->parent) { top = top->parent; }
+  return top->pathIndex.get();
+}
+
+void Directory::reserve(size_t n) {
+  ensureLoaded();
+  children.reserve(n);
+  if (n >= childIndexThreshold && !childIndex.active()) {
+    childIndex.reserve(n);
+    for (FilesystemComponent *child: children) { childIndex.insert(child); }
+  }
+}
+
+void Directory::loadLazyChildren() {
+  LazyChildSource *source = lazySource;
+  lazySource = nullptr;
+  std::vector<ComponentPtr> loaded = source->loadChildren(*this, lazyToken);
+  children.reserve(loaded.size());
+  if (loaded.size() >= childIndexThreshold) { childIndex.reserve(loaded.size()); }
+  for (ComponentPtr &child: loaded) {
+    child->parent = this;
+    children.push_back(child.release());
+    if (childIndex.active()) { childIndex.insert(children.back()); }
+  }
+  if (PathIndex *index = findPathIndex()) {
+    for (FilesystemComponent *child: children) { index->insertSubtree(*child); }
+  }
+}
+
+void Directory::add(ComponentPtr owned) {
+  if (!owned) { return; }
+  ensureLoaded();
+  // children에 들어간 뒤에야 소유권을 놓음 (push_back이 실패하면 owned가 해제)
+  children.push_back(owned.get());
+  FilesystemComponent *component = owned.release();
+  component->parent = this;
+  if (childIndex.active()) {
+    childIndex.insert(component);
+  } else if (children.size() >= childIndexThreshold) {
+    for (FilesystemComponent *child: children) { childIndex.insert(child); }
+  }
+  propagate(component->getSize(), component->getFileCount(),
+            component->getDirectoryCount() + (component->isDirectory() ? 1 : 0));
+  if (PathIndex *index = findPathIndex()) { index->insertSubtree(*component); }
+}
+
+FilesystemComponent *Directory::findChild(std::string_view childName) const {
+  ensureLoaded();
+  if (childIndex.active()) { return childIndex.find(childName); }
+  for (FilesystemComponent *child: children) {
+    if (child->name == childName) { return child; }
+  }
+  return nullptr;
+}
+
+ComponentPtr Directory::remove(FilesystemComponent *component) {
+  auto found = std::find(children.begin(), children.end(), component);
+  if (found == children.end()) { return nullptr; }
+  if (PathIndex *index = findPathIndex()) { index->eraseSubtree(*component); }
+  children.erase(found);
+  childIndex.erase(component);
+  component->parent = nullptr;
+  propagate(-component->getSize(), -component->getFileCount(),
+            -(component->getDirectoryCount() + (component->isDirectory() ? 1 : 0)));
+  return ComponentPtr(component);
+}
+
+std::vector<ComponentPtr> Directory::takeChildren() {
+  lazySource = nullptr;  // 펼치지 않았으면 만들 필요도 없음
+  PathIndex *index = findPathIndex();
+  std::vector<ComponentPtr> taken;
+  taken.reserve(children.size());
+  for (FilesystemComponent *child: children) {
+    if (index) { index->eraseSubtree(*child); }
+    child->parent = nullptr;
+    taken.emplace_back(child);
+  }
+  children.clear();
+  childIndex.clear();
+  propagate(-totalSize, -fileCount, -dirCount);
+  return taken;
+}
+
+void Directory::renameChild(FilesystemComponent *child, std::string_view newName) {
+  PathIndex *index = findPathIndex();
+  if (index) { index->eraseSubtree(*child); }
+  childIndex.erase(child);
+  child->assignName(newName);
+  invalidateContentHash();
+  if (childIndex.active()) { childIndex.insert(child); }
+  if (index) { index->insertSubtree(*child); }
+}
+
+void FilesystemComponent::setName(std::string_view n) {
+  if (parent) {
+    parent->renameChild(this, n);
+  } else {
+    assignName(n);
+  }
+}
+
+void Directory::enablePathIndex() {
+  if (pathIndex) { return; }
+  pathIndex = std::make_unique<PathIndex>(*this);
+  pathIndex->insertSubtree(*this);
+}
+
+void Directory::disablePathIndex() { pathIndex.reset(); }
+
+FilesystemComponent *Directory::find(std::string_view path) {
+  if (pathIndex) { return pathIndex->find(normalizeTreePath(path)); }
+  // 색인이 없으면 구성 요소마다 자식 색인으로 찾아 내려감
+  FilesystemComponent *node = this;
+  size_t pos = 0;
+  while (node && pos <= path.size()) {
+    size_t end = path.find('/', pos);
+    if (end == std::string_view::npos) { end = path.size(); }
+    std::string_view part = path.substr(pos, end - pos);
+    pos = end + 1;
+    if (part.empty() || part == ".") { continue; }
+    node = node->isDirectory() ? static_cast<Directory *>(node)->findChild(part) : nullptr;
+  }
+  return node;
+}
+
+std::optional<long long> Directory::getSize(std::string_view path) {
+  FilesystemComponent *node = find(path);
+  if (!node) { return std::nullopt; }
+  return node->getSize();
+}
+
+void Directory::recomputeTotals() {
+  // 펼치지 않은 디렉터리는 미리 받은 합계가 맞으므로 들어가지 않음
+  traverseTree(*this,
+               [](FilesystemComponent &node, int) {
+                 return !node.isDirectory() || static_cast<Directory &>(node).isLoaded();
+               },
+               [](Directory &dir, int) { dir.recomputeLocalTotals(); });
+}
+
+// 64비트 해시 섞기 (splitmix64 마무리 단계)
+inline uint64_t mixHash(uint64_t value) {
+  value ^= value >> 30;
+  value *= 0xbf58476d1ce4e5b9ULL;
+  value ^= value >> 27;
+  value *= 0x94d049bb133111ebULL;
+  value ^= value >> 31;
+  return value;
+}
+
+// 부모 해시에 들어가는 자식 하나의 몫 (이름, 종류, 내용). 자식끼리는 더하기로 합쳐서 순서와 무관하게 함
+inline uint64_t childHashContribution(const FilesystemComponent &child, uint64_t content) {
+  uint64_t nameHash = std::hash<std::string_view>()(child.getNameView());
+  return mixHash(nameHash ^ mixHash(content + (child.isDirectory() ? 0x9e3779b97f4a7c15ULL : 0)));
+}
+
+// 자식 몫을 모두 더한 값으로 디렉터리 자신의 해시를 냄
+// 접힌 디렉터리는 자식이 없으므로 합계(크기, 파일 수, 디렉터리 수)를 섞어야 빈 디렉터리나 합계가 다른 접힌 디렉터리와 구별됨
+inline uint64_t directoryHash(const Directory &dir, uint64_t childSum) {
+  uint64_t hash = mixHash(childSum + dir.getChildren().size());
+  if (dir.isCollapsed()) {
+    hash = mixHash(hash ^ mixHash(static_cast<uint64_t>(dir.getSize())));
+    hash = mixHash(hash ^ mixHash(static_cast<uint64_t>(dir.getFileCount()) + 0x632be59bd9b4e019ULL));
+    hash = mixHash(hash ^ mixHash(static_cast<uint64_t>(dir.getDirectoryCount()) + 0x8cb92ba72f3d8dd7ULL));
+  }
+  return hash;
+}
+
+uint64_t Directory::getContentHash() const {
+  if (contentHashValid) { return contentHash; }
+  // 캐시가 없는 디렉터리만 후위 순서로 계산 (캐시가 있는 하위 트리는 들어가지 않음)
+  traverseTree(*this,
+               [](const FilesystemComponent &node, int) {
+                 return node.isDirectory() && !static_cast<const Directory &>(node).contentHashValid;
+               },
+               [](const Directory &dir, int) {
+                 uint64_t sum = 0;
+                 for (const FilesystemComponent *child: dir.getChildren()) {
+                   uint64_t content = child->isDirectory() ? static_cast<const Directory *>(child)->contentHash
+                                                           : mixHash(static_cast<uint64_t>(child->getSize()));
+                   sum += childHashContribution(*child, content);
+                 }
+                 dir.contentHash = directoryHash(dir, sum);
+                 dir.contentHashValid = true;
+               });
+  return contentHash;
+}
+
+// getContentHash()와 같은 값을 캐시 없이 한 번의 순회 안에서 계산 (다른 연산과 합쳐 돌릴 때)
+struct HashFold : TreeFold {
+  std::vector<uint64_t> sums;  // 열린 디렉터리마다 자식 몫의 합
+  uint64_t result = 0;
+  void file(const File &node, int) { sums.back() += childHashContribution(node, mixHash(static_cast<uint64_t>(node.getSize()))); }
+  void enter(const Directory &, int) { sums.push_back(0); }
+  void leave(const Directory &dir, int) {
+    uint64_t hash = directoryHash(dir, sums.back());
+    sums.pop_back();
+    if (sums.empty()) {
+      result = hash;
+    } else {
+      sums.back() += childHashContribution(dir, hash);
+    }
+  }
+};
+
+void Directory::display(OutputSink &sink, int indent) const {
+  FS_PHASE_SCOPE(InstrumentPhase::Display);
+  DisplayFold fold(sink, indent);
+  foldTree(*this, fold);
+}
+
+void Directory::serialize(OutputSink &sink) const {
+  FS_PHASE_SCOPE(InstrumentPhase::Serialize);
+  SerializeFold fold(sink);
+  foldTree(*this, fold);
+}
+
+// arena가 소유하는 트리. 소멸할 때 노드를 하나씩 지우지 않고 arena 단위로 한 번에 해제함
+class FilesystemTree {
+  private:
+    TreeArena arena;
+    Directory *root;
+  public:
+    explicit FilesystemTree(std::string_view rootName): root(arena.make<Directory>(rootName)) {}
+    FilesystemTree(const FilesystemTree &) = delete;
+    FilesystemTree &operator=(const FilesystemTree &) = delete;
+    // arena 노드의 소멸자는 호출되지 않으므로 힙에 있는 경로 색인만 직접 해제
+    ~FilesystemTree() { root->disablePathIndex(); }
+    Directory *getRoot() { return root; }
+    TreeArena &getArena() { return arena; }
+};
+
+void File::setSize(long long s) {
+  long long delta = s - size;
+  size = s;
+  if (parent && delta != 0) { parent->propagate(delta, 0, 0); }
+}
+
+// 전위 순서 이벤트(beginDirectory/addFile/endDirectory)를 받아 노드 트리를 만드는 빌더
+// 첫 beginDirectory는 root 자신이고, 하위 디렉터리는 다 채운 뒤 부모에 붙이므로 합계 전파는 노드마다 한 번씩만 일어남
+class ComponentTreeBuilder {
+  private:
+    struct Frame {
+      Directory *dir;
+      ComponentPtr owner;  // 아직 부모에 붙지 않은 디렉터리 (root는 nullptr)
+    };
+    static constexpr long long maxReservedChildren = 1 << 16;
+    Directory &root;
+    std::vector<Frame> stack;
+
+  public:
+    explicit ComponentTreeBuilder(Directory &r): root(r) {}
+
+    // childCount는 자리를 미리 잡는 데만 쓰임 (잘못된 입력의 큰 값에 대비해 한도를 둠)
+    Directory *beginDirectory(std::string_view dirName, long long childCount) {
+      Directory *dir = &root;
+      if (stack.empty()) {
+        root.setName(dirName);
+        stack.push_back({&root, nullptr});
+      } else {
+        DirectoryPtr created = stack.back().dir->createDirectory(dirName);
+        dir = created.get();
+        stack.push_back({dir, std::move(created)});
+      }
+      dir->reserve(static_cast<size_t>(std::clamp<long long>(childCount, 0, maxReservedChildren)));
+      return dir;
+    }
+
+    void addFile(std::string_view fileName, long long fileSize) {
+      Directory *dir = stack.back().dir;
+      dir->add(dir->createFile(fileName, fileSize));
+    }
+
+    void endDirectory() {
+      ComponentPtr done = std::move(stack.back().owner);
+      stack.pop_back();
+      if (!stack.empty()) { stack.back().dir->add(std::move(done)); }
+    }
+
+    // 깊이 제한으로 접힌 디렉터리 (자식 없이 합계만). 첫 이벤트면 root 자신
+    void addCollapsedDirectory(std::string_view dirName, long long size, long long files, long long dirs) {
+      if (stack.empty()) {
+        root.setName(dirName);
+        root.setCollapsed(size, files, dirs);
+        return;
+      }
+      Directory *parent = stack.back().dir;
+      DirectoryPtr dir = parent->createDirectory(dirName);
+      dir->setCollapsed(size, files, dirs);
+      parent->add(std::move(dir));
+    }
+
+    // 모든 디렉터리가 닫혔는지
+    bool finished() const { return stack.empty(); }
+};
+
+// 역직렬화 입력이 잘못되었을 때 던지는 예외. offset()은 문제가 발견된 바이트 위치
+class DeserializeError : public std::runtime_error {
+  private:
+    size_t position;
+  public:
+    DeserializeError(const std::string &message, size_t pos)
+        : std::runtime_error(message + " at byte " + std::to_string(pos)), position(pos) {}
+    size_t offset() const { return position; }
+};
+
+// serialize() 결과(D|name|count[...], F|name|size, 접힌 디렉터리는 C|name|size|files|dirs)를 한 번만 훑으면서 트리를 만드는 파서
+// 입력은 string_view로 보기만 하고 부분 문자열 복사 없이 이름을 바로 노드에 넘김
+class SnapshotParser {
+  private:
+    std::string_view data;
+    size_t pos = 0;
+
+    [[noreturn]] void fail(const std::string &message) const { throw DeserializeError(message, pos); }
+
+    void expect(char c) {
+      if (pos >= data.size() || data[pos] != c) { fail(std::string("expected '") + c + "'"); }
+      ++pos;
+    }
+
+    // 다음 '|'까지를 이름으로 읽고 '|'는 건너뜀
+    // (64바이트마다 '|' 비트마스크를 만들어 두고 따라가는 방식도 재 봤지만 --bench의 parse에서 find보다 빠르지 않았음)
+    std::string_view readName() {
+      size_t end = data.find('|', pos);
+      if (end == std::string_view::npos) { fail("unterminated name"); }
+      std::string_view result = data.substr(pos, end - pos);
+      pos = end + 1;
+      return result;
+    }
+
+    long long readNumber() {
+      if (pos >= data.size() || data[pos] < '0' || data[pos] > '9') { fail("expected a number"); }
+      long long value = 0;
+      const char *end = decimal::parse(data.data() + pos, data.data() + data.size(), value);
+      if (!end) { fail("number out of range"); }
+      pos = static_cast<size_t>(end - data.data());
+      return value;
+    }
+
+    // C|name|size|files|dirs
+    template <typename Builder>
+    void parseCollapsed(Builder &builder) {
+      expect('C');
+      expect('|');
+      std::string_view dirName = readName();
+      long long dirSize = readNumber();
+      expect('|');
+      long long files = readNumber();
+      expect('|');
+      long long dirs = readNumber();
+      builder.addCollapsedDirectory(dirName, dirSize, files, dirs);
+    }
+
+  public:
+    explicit SnapshotParser(std::string_view d): data(d) {}
+
+    // F|name|size 하나 (입력 전체가 파일 하나여야 함)
+    void parseFile(File &file) {
+      expect('F');
+      expect('|');
+      std::string_view fileName = readName();
+      long long fileSize = readNumber();
+      if (pos != data.size()) { fail("unexpected trailing data"); }
+      file.setName(fileName);
+      file.setSize(fileSize);
+    }
+
+    // D|name|count[...] 하나를 읽으면서 builder에 전위 순서로 알림
+    //   builder.beginDirectory(name, childCount), builder.addFile(name, size), builder.endDirectory(),
+    //   builder.addCollapsedDirectory(name, size, files, dirs)
+    template <typename Builder>
+    void parse(Builder &builder) {
+      std::vector<long long> remaining;  // 열려 있는 디렉터리마다 남은 자식 수
+
+      if (pos < data.size() && data[pos] == 'C') {
+        parseCollapsed(builder);
+        if (pos != data.size()) { fail("unexpected trailing data"); }
+        return;
+      }
+      expect('D');
+      expect('|');
+      std::string_view rootName = readName();
+      long long count = readNumber();
+      expect('[');
+      builder.beginDirectory(rootName, count);
+      remaining.push_back(count);
+
+      while (!remaining.empty()) {
+        if (remaining.back() == 0) {
+          expect(']');
+          remaining.pop_back();
+          builder.endDirectory();
+          continue;
+        }
+
+        --remaining.back();
+        if (pos >= data.size()) { fail("unexpected end of input"); }
+        char tag = data[pos];
+        if (tag == 'F') {
+          ++pos;
+          expect('|');
+          std::string_view fileName = readName();
+          long long fileSize = readNumber();
+          builder.addFile(fileName, fileSize);
+        } else if (tag == 'D') {
+          ++pos;
+          expect('|');
+          std::string_view dirName = readName();
+          long long childCount = readNumber();
+          expect('[');
+          builder.beginDirectory(dirName, childCount);
+          remaining.push_back(childCount);
+        } else if (tag == 'C') {
+          parseCollapsed(builder);
+        } else if (tag == ']') {
+          fail("fewer children than declared");
+        } else {
+          fail("expected 'F', 'D' or 'C'");
+        }
+      }
+      if (pos != data.size()) { fail("unexpected trailing data"); }
+    }
+
+    // D|name|count[...] 하나를 root에 복원 (root는 비어 있어야 함)
+    void parseDirectory(Directory &root) {
+      ComponentTreeBuilder builder(root);
+      parse(builder);
+    }
+};
+
+void File::deserialize(std::string_view data) {
+  SnapshotParser(data).parseFile(*this);
+}
+
+// 직렬화된 문자열로부터 디렉터리 객체의 상태와 하위 구조 복원
+// 잘못된 입력이면 DeserializeError를 던짐 (그때까지 복원된 자식은 남아 있음)
+void Directory::deserialize(std::string_view data) {
+  FS_PHASE_SCOPE(InstrumentPhase::Deserialize);
+  takeChildren();
+  SnapshotParser(data).parseDirectory(*this);
+}
+
+// 바이너리 스냅샷 (버전 3, 정수는 모두 little-endian)
+//   헤더: "FSNP" | u32 version | u64 nodeCount | u64 tableBytes | u64 poolBytes
+//         | u64 totalSize | u64 fileCount | u64 dirCount
+//   노드 테이블: 전위 순회 순서로 노드마다
+//         tag('F' 또는 'D') | varint nameOffset | varint nameLength | varint size
+//         | (D만) varint childCount | u64 subtreeBytes | varint fileCount | varint dirCount
+//                | varint stampFlags | (stampFlags == 1이면) zigzag mtimeNs | varint inode | varint device
+//         디렉터리의 size, fileCount, dirCount는 하위 트리 합계 (자기 제외)
+//         subtreeBytes는 이 레코드 바로 뒤에 이어지는 하위 트리 레코드들의 바이트 수 (하위 트리를 읽지 않고 건너뛸 때 씀)
+//         버전 2에는 subtreeBytes/fileCount/dirCount가 없고, 버전 1에는 stamp 부분도 없음
+//   이름 풀: 이름 바이트를 이어 붙인 것 (같은 이름은 한 번만 저장)
+// 이름에 '|', '[', ']'가 있어도 문제없음
+constexpr char binarySnapshotMagic[4] = {'F', 'S', 'N', 'P'};
+constexpr uint32_t binarySnapshotVersion = 3;
+constexpr size_t binarySnapshotHeaderBytes = 4 + 4 + 8 * 6;
+
+void appendVarint(std::string &out, uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+}
+
+uint64_t zigzagEncode(long long value) {
+  return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+long long zigzagDecode(uint64_t value) {
+  return static_cast<long long>(value >> 1) ^ -static_cast<long long>(value & 1);
+}
+
+void appendFixed(std::string &out, uint64_t value, int bytes) {
+  for (int i = 0; i < bytes; ++i) { out.push_back(static_cast<char>((value >> (8 * i)) & 0xff)); }
+}
+
+class BinarySnapshotWriter {
+  private:
+    std::string table;
+    std::string pool;
+    std::unordered_map<std::string_view, uint64_t> nameOffsets;
+    uint64_t nodeCount = 0;
+    // 열린 디렉터리마다 subtreeBytes 자리와 하위 트리가 시작하는 위치 (닫을 때 채움)
+    struct OpenSubtree {
+      size_t slot;
+      size_t start;
+    };
+    std::vector<OpenSubtree> openSubtrees;
+
+    void writeNode(const FilesystemComponent &node) {
+      std::string_view nodeName = node.getNameView();
+      auto found = nameOffsets.find(nodeName);
+      uint64_t offset;
+      if (found != nameOffsets.end()) {
+        offset = found->second;
+      } else {
+        offset = pool.size();
+        pool.append(nodeName.data(), nodeName.size());
+        nameOffsets.emplace(nodeName, offset);
+      }
+
+      ++nodeCount;
+      table.push_back(node.isDirectory() ? 'D' : 'F');
+      appendVarint(table, offset);
+      appendVarint(table, nodeName.size());
+      appendVarint(table, static_cast<uint64_t>(node.getSize()));
+      if (node.isDirectory()) {
+        const Directory &dir = static_cast<const Directory &>(node);
+        // 읽는 쪽은 합계를 파일 크기로부터 다시 세므로 접힌 디렉터리는 빈 디렉터리가 되어 버림
+        if (dir.isCollapsed()) { throw std::runtime_error("binary snapshot cannot hold directories collapsed by --max-depth"); }
+        appendVarint(table, dir.getChildren().size());
+        size_t slot = table.size();
+        appendFixed(table, 0, 8);
+        appendVarint(table, static_cast<uint64_t>(dir.getFileCount()));
+        appendVarint(table, static_cast<uint64_t>(dir.getDirectoryCount()));
+        const DirectoryStamp &stamp = dir.getStamp();
+        appendVarint(table, stamp.valid ? 1 : 0);
+        if (stamp.valid) {
+          appendVarint(table, zigzagEncode(stamp.mtimeNs));
+          appendVarint(table, stamp.inode);
+          appendVarint(table, stamp.device);
+        }
+        openSubtrees.push_back({slot, table.size()});
+      }
+    }
+
+    void closeDirectory() {
+      OpenSubtree done = openSubtrees.back();
+      openSubtrees.pop_back();
+      uint64_t subtreeBytes = table.size() - done.start;
+      for (int i = 0; i < 8; ++i) { table[done.slot + i] = static_cast<char>((subtreeBytes >> (8 * i)) & 0xff); }
+    }
+
+  public:
+    // root 트리를 스냅샷으로 써 넣음. 트리는 쓰는 동안 바뀌면 안 됨
+    void write(const FilesystemComponent &root, OutputSink &sink) {
+      table.clear();
+      pool.clear();
+      nameOffsets.clear();
+      nodeCount = 0;
+      openSubtrees.clear();
+      traverseTree(root,
+                   [this](const FilesystemComponent &node, int) {
+                     writeNode(node);
+                     return true;
+                   },
+                   [this](const Directory &, int) { closeDirectory(); });
+
+      std::string header(binarySnapshotMagic, sizeof(binarySnapshotMagic));
+      appendFixed(header, binarySnapshotVersion, 4);
+      appendFixed(header, nodeCount, 8);
+      appendFixed(header, table.size(), 8);
+      appendFixed(header, pool.size(), 8);
+      appendFixed(header, static_cast<uint64_t>(root.getSize()), 8);
+      appendFixed(header, static_cast<uint64_t>(root.getFileCount()), 8);
+      appendFixed(header, static_cast<uint64_t>(root.getDirectoryCount()), 8);
+      sink.write(header);
+      sink.write(table);
+      sink.write(pool);
+    }
+};
+
+// 바이너리 스냅샷 파일을 mmap 해서 노드 객체를 만들지 않고 바로 읽는 뷰
+// 합계는 헤더에서 O(1)로, display()는 노드 테이블을 한 번 훑어서 답함 (추가 메모리는 깊이에 비례)
+class SnapshotView {
+  public:
+    // 노드 테이블을 읽으면서 얻는 노드 하나
+    struct Node {
+      std::string_view name;
+      long long size;
+      bool isDirectory;
+      uint64_t childCount;
+      DirectoryStamp stamp;
+      // 버전 3부터 있는 디렉터리 합계와 하위 트리 레코드의 바이트 수 (그 전 버전이면 0)
+      long long fileCount = 0;
+      long long dirCount = 0;
+      uint64_t subtreeBytes = 0;
+    };
+
+  private:
+    const char *base = nullptr;
+    size_t length = 0;
+#if defined(__unix__) || defined(__APPLE__)
+    bool mapped = false;
+#endif
+    std::string fallback;  // mmap을 못 쓰는 환경에서 파일 내용을 담아 둠
+    uint32_t version = 0;
+    uint64_t nodeCount = 0;
+    size_t tableStart = 0;
+    size_t tableEnd = 0;
+    size_t poolStart = 0;
+    size_t poolBytes = 0;
+    long long totalSize = 0;
+    long long fileCount = 0;
+    long long dirCount = 0;
+
+    uint64_t readFixed(size_t offset, int bytes) const {
+      uint64_t value = 0;
+      for (int i = 0; i < bytes; ++i) {
+        value |= static_cast<uint64_t>(static_cast<unsigned char>(base[offset + i])) << (8 * i);
+      }
+      return value;
+    }
+
+    uint64_t readVarint(size_t &pos) const {
+      uint64_t value = 0;
+      for (int shift = 0; shift < 64; shift += 7) {
+        if (pos >= tableEnd) { throw DeserializeError("truncated node table", pos); }
+        unsigned char byte = static_cast<unsigned char>(base[pos++]);
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) { return value; }
+      }
+      throw DeserializeError("varint too long", pos);
+    }
+
+    void validateHeader() {
+      if (length < binarySnapshotHeaderBytes || std::string_view(base, 4) != std::string_view(binarySnapshotMagic, 4)) {
+        throw DeserializeError("not a binary snapshot", 0);
+      }
+      version = static_cast<uint32_t>(readFixed(4, 4));
+      if (version < 1 || version > binarySnapshotVersion) { throw DeserializeError("unsupported snapshot version", 4); }
+      nodeCount = readFixed(8, 8);
+      uint64_t tableBytes = readFixed(16, 8);
+      poolBytes = readFixed(24, 8);
+      totalSize = static_cast<long long>(readFixed(32, 8));
+      fileCount = static_cast<long long>(readFixed(40, 8));
+      dirCount = static_cast<long long>(readFixed(48, 8));
+      tableStart = binarySnapshotHeaderBytes;
+      if (tableBytes > length - tableStart || poolBytes != length - tableStart - tableBytes) {
+        throw DeserializeError("snapshot size does not match header", 16);
+      }
+      tableEnd = tableStart + tableBytes;
+      poolStart = tableEnd;
+    }
+
+  public:
+    explicit SnapshotView(const std::string &path) {
+#if defined(__unix__) || defined(__APPLE__)
+      int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+      if (fd < 0) { throw std::system_error(errno, std::generic_category(), "open " + path); }
+      struct stat st;
+      if (fstat(fd, &st) != 0) {
+        int err = errno;
+        close(fd);
+        throw std::system_error(err, std::generic_category(), "fstat " + path);
+      }
+      length = static_cast<size_t>(st.st_size);
+      if (length > 0) {
+        void *memory = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (memory == MAP_FAILED) {
+          int err = errno;
+          close(fd);
+          throw std::system_error(err, std::generic_category(), "mmap " + path);
+        }
+        base = static_cast<const char *>(memory);
+        mapped = true;
+      }
+      close(fd);
+#else
+      std::ifstream in(path, std::ios::binary);
+      if (!in) { throw std::runtime_error("cannot open " + path); }
+      fallback.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+      base = fallback.data();
+      length = fallback.size();
+#endif
+      try {
+        validateHeader();
+      } catch (...) {
+        release();
+        throw;
+      }
+    }
+    SnapshotView(const SnapshotView &) = delete;
+    SnapshotView &operator=(const SnapshotView &) = delete;
+    ~SnapshotView() { release(); }
+
+    void release() {
+#if defined(__unix__) || defined(__APPLE__)
+      if (mapped) { munmap(const_cast<char *>(base), length); }
+      mapped = false;
+#endif
+      base = nullptr;
+      length = 0;
+    }
+
+    long long getSize() const { return totalSize; }
+    long long getFileCount() const { return fileCount; }
+    long long getDirectoryCount() const { return dirCount; }
+    uint64_t getNodeCount() const { return nodeCount; }
+    uint32_t getVersion() const { return version; }
+    // 루트 레코드의 위치 (readNode()에 넘김)
+    size_t getTableStart() const { return tableStart; }
+    size_t getTableEnd() const { return tableEnd; }
+
+    // pos 위치의 노드 하나를 읽고 pos를 다음 노드로 옮김
+    Node readNode(size_t &pos) const {
+      if (pos >= tableEnd) { throw DeserializeError("truncated node table", pos); }
+      char tag = base[pos];
+      if (tag != 'F' && tag != 'D') { throw DeserializeError("bad node tag", pos); }
+      ++pos;
+      uint64_t nameOffset = readVarint(pos);
+      uint64_t nameLength = readVarint(pos);
+      if (nameOffset > poolBytes || nameLength > poolBytes - nameOffset) {
+        throw DeserializeError("name outside of name pool", pos);
+      }
+      Node node;
+      node.name = std::string_view(base + poolStart + nameOffset, nameLength);
+      node.size = static_cast<long long>(readVarint(pos));
+      node.isDirectory = tag == 'D';
+      node.childCount = node.isDirectory ? readVarint(pos) : 0;
+      if (node.isDirectory && version >= 3) {
+        if (tableEnd - pos < 8) { throw DeserializeError("truncated node table", pos); }
+        node.subtreeBytes = readFixed(pos, 8);
+        pos += 8;
+        node.fileCount = static_cast<long long>(readVarint(pos));
+        node.dirCount = static_cast<long long>(readVarint(pos));
+      }
+      if (node.isDirectory && version >= 2 && readVarint(pos) == 1) {
+        node.stamp.mtimeNs = zigzagDecode(readVarint(pos));
+        node.stamp.inode = readVarint(pos);
+        node.stamp.device = readVarint(pos);
+        node.stamp.valid = true;
+      }
+      return node;
+    }
+
+    // 모든 노드를 전위 순회 순서로 visit(node, depth)에 넘김
+    template <typename Visitor>
+    void forEach(Visitor &&visit) const {
+      std::vector<uint64_t> remaining;  // 깊이별로 남은 자식 수
+      size_t pos = tableStart;
+      for (uint64_t i = 0; i < nodeCount; ++i) {
+        while (!remaining.empty() && remaining.back() == 0) { remaining.pop_back(); }
+        if (i > 0 && remaining.empty()) { throw DeserializeError("node outside of root", pos); }
+        int depth = static_cast<int>(remaining.size());
+        if (!remaining.empty()) { --remaining.back(); }
+        Node node = readNode(pos);
+        visit(node, depth);
+        if (node.isDirectory) { remaining.push_back(node.childCount); }
+      }
+      if (pos != tableEnd) { throw DeserializeError("unexpected data after node table", pos); }
+    }
+
+    // 스냅샷 전체를 root 아래에 노드 트리로 복원 (root는 비어 있어야 함, 디렉터리 stamp도 복원됨)
+    void materialize(Directory &root) const {
+      ComponentTreeBuilder builder(root);
+      std::vector<uint64_t> remaining;  // 열려 있는 디렉터리마다 남은 자식 수
+      size_t pos = tableStart;
+      for (uint64_t i = 0; i < nodeCount; ++i) {
+        size_t nodeStart = pos;
+        Node node = readNode(pos);
+        if (i == 0 && !node.isDirectory) { throw DeserializeError("root is not a directory", nodeStart); }
+        if (i > 0 && remaining.empty()) { throw DeserializeError("node outside of root", nodeStart); }
+        if (!remaining.empty()) { --remaining.back(); }
+        if (node.isDirectory) {
+          builder.beginDirectory(node.name, static_cast<long long>(node.childCount))->setStamp(node.stamp);
+          remaining.push_back(node.childCount);
+        } else {
+          builder.addFile(node.name, node.size);
+        }
+        while (!remaining.empty() && remaining.back() == 0) {
+          remaining.pop_back();
+          builder.endDirectory();
+        }
+      }
+      if (!builder.finished()) { throw DeserializeError("truncated node table", pos); }
+      if (pos != tableEnd) { throw DeserializeError("unexpected data after node table", pos); }
+    }
+
+    // Directory::display()와 같은 형식으로 출력
+    void display(OutputSink &sink) const {
+      forEach([&sink](const Node &node, int depth) {
+        writeDisplayLine(sink, depth, node.name, node.size, node.isDirectory);
+      });
+    }
+};
+
+// 스캔 중 읽어 들인 디렉터리 항목 하나
+struct ScanEntry {
+  std::string name;
+  bool isDirectory;
+  long long size;
+  // 디렉터리의 (device, inode). 스캐너가 순환을 막는 데 씀 (inode가 0이면 모름, device가 0이면 부모와 같은 장치)
+  uint64_t device = 0;
+  uint64_t inode = 0;
+};
+
+// 크기를 세는 방식
+//   dedupHardLinks: 링크가 여럿인 파일은 (device, inode)마다 처음 만난 것만 크기를 세고 나머지는 0 bytes로 둠
+//   diskUsage: 겉보기 크기(st_size) 대신 실제로 할당된 블록(st_blocks * 512)으로 셈 (sparse 파일은 작아짐)
+//   maxDepth: 이 깊이(루트 0)의 디렉터리는 하위를 읽어 합계만 갖고 노드는 만들지 않음 (음수면 제한 없음, 노드 트리 스캐너만 사용)
+//   symlinks: Follow면 기존처럼 링크 대상을 따라가고(조상 디렉터리로 돌아가는 링크는 빈 디렉터리로 남김), Skip이면 링크를 무시함
+// 모두 원래 크기를 얻던 stat/statx 한 번의 결과로 처리하므로 시스템 호출이 늘지 않음
+enum class SymlinkPolicy { Follow, Skip };
+// 순환 검사용 디렉터리 식별 (device, inode)
+using DirectoryIdentity = std::pair<uint64_t, uint64_t>;
+// dedupHardLinks에서 링크가 여럿인 파일 하나를 셀지 정하는 방법
+//   New: 처음 만난 (device, inode)면 세고, 이미 센 것이면 0 bytes
+//   Counted/Duplicate: 트리에 이미 있는 노드를 다시 읽을 때 처음 정한 쪽을 유지함 (센 노드는 계속 세고 0으로 둔 노드는 계속 0)
+enum class LinkAccounting { New, Counted, Duplicate };
+struct ScanPolicy {
+  bool dedupHardLinks = false;
+  bool diskUsage = false;
+  SymlinkPolicy symlinks = SymlinkPolicy::Follow;
+  int maxDepth = -1;
+};
+
+// 이미 센 (device, inode) 집합. 병렬 스캐너의 여러 스레드가 동시에 넣으므로 잠금을 조각마다 따로 둠
+class InodeSet {
+  private:
+    struct Key {
+      uint64_t device;
+      uint64_t inode;
+      bool operator==(const Key &other) const { return device == other.device && inode == other.inode; }
+    };
+    struct KeyHash {
+      size_t operator()(const Key &key) const {
+        uint64_t h = (key.device * 0x9e3779b97f4a7c15ULL) ^ key.inode;
+        h ^= h >> 31;
+        h *= 0xbf58476d1ce4e5b9ULL;
+        return static_cast<size_t>(h ^ (h >> 29));
+      }
+    };
+    static constexpr size_t shardCount = 64;
+    struct alignas(64) Shard {
+      std::mutex lock;
+      std::unordered_set<Key, KeyHash> keys;
+    };
+    Shard shards[shardCount];
+
+  public:
+    // 처음 넣은 것이면 true
+    bool insert(uint64_t device, uint64_t inode) {
+      Key key{device, inode};
+      Shard &shard = shards[(KeyHash()(key) >> 7) % shardCount];
+      std::lock_guard<std::mutex> guard(shard.lock);
+      return shard.keys.insert(key).second;
+    }
+    void clear() {
+      for (Shard &shard: shards) {
+        std::lock_guard<std::mutex> guard(shard.lock);
+        shard.keys.clear();
+      }
+    }
+};
+
+// 스캔에 든 항목 수와 시스템 호출 수 (여러 스레드에서 같이 갱신됨)
+struct ScanStats {
+  std::atomic<long long> entries{0};
+  std::atomic<long long> directories{0};
+  std::atomic<long long> syscalls{0};
+  std::atomic<long long> duplicateLinks{0};  // 이미 센 하드 링크라서 0 bytes로 둔 파일 수
+  std::atomic<long long> skippedCycles{0};   // 조상 디렉터리로 돌아가서 건너뛴 심볼릭 링크 수
+  std::atomic<long long> filteredOut{0};     // 필터에 걸려 빠진 항목 수 (빠진 디렉터리는 열지 않음)
+
+  double syscallsPerEntry() const {
+    return entries > 0 ? static_cast<double>(syscalls) / static_cast<double>(entries) : 0.0;
+  }
+};
+
+// 디렉터리 하나의 항목을 읽는 방식. 스캐너(직렬/병렬)는 이 인터페이스만 사용한다
+// readDirectory()는 여러 스레드에서 동시에 호출될 수 있어야 함
+class ScanBackend {
+  protected:
+    // 일반 파일 하나를 policy대로 센 크기 (같은 backend로 한 스캔은 하드 링크를 함께 셈. 새로 세려면 resetAccounting())
+    long long accountFile(uint64_t device, uint64_t inode, uint64_t links, long long size, long long blocks,
+                          LinkAccounting accounting = LinkAccounting::New) {
+      if (policy.dedupHardLinks && links > 1) {
+        // 센 쪽은 (device, inode)를 차지해 둠 (링크가 하나일 때 세어서 아직 집합에 없을 수 있음)
+        bool first = seenLinks.insert(device, inode);
+        if (accounting == LinkAccounting::Duplicate || (accounting == LinkAccounting::New && !first)) {
+          if (accounting == LinkAccounting::New) { ++stats.duplicateLinks; }
+          return 0;
+        }
+      }
+      return policy.diskUsage ? blocks * 512 : size;
+    }
+
+    // 다른 backend를 감싸는 backend용: 통계와 이미 센 inode 집합은 안쪽과 같은 것을 쓰고 policy는 복사해 옴
+    explicit ScanBackend(ScanBackend &inner): stats(inner.stats), policy(inner.policy), seenLinks(inner.seenLinks) {}
+
+  private:
+    ScanStats ownStats;
+    InodeSet ownLinks;
+
+  public:
+    ScanStats &stats;
+    ScanPolicy policy;
+    InodeSet &seenLinks;
+    ScanBackend(): stats(ownStats), seenLinks(ownLinks) {}
+    ScanBackend(const ScanBackend &) = delete;
+    ScanBackend &operator=(const ScanBackend &) = delete;
+    virtual ~ScanBackend() = default;
+
+    void resetAccounting() { seenLinks.clear(); }
+    // 스캐너가 policy.symlinks == Follow일 때 순환 검사에 쓰는 시작 디렉터리의 식별 (stat 한 번)
+    DirectoryIdentity rootIdentity(const fs::path &path) {
+      if (policy.symlinks != SymlinkPolicy::Follow) { return {0, 0}; }
+      DirectoryStamp stamp = statDirectory(path);
+      return {stamp.device, stamp.inode};
+    }
+    // 하위 디렉터리 항목의 식별. 목록에서 온 inode에는 장치 정보가 없으므로 부모의 장치를 씀
+    static DirectoryIdentity childIdentity(const DirectoryIdentity &parent, const ScanEntry &entry) {
+      return {entry.device ? entry.device : parent.first, entry.inode};
+    }
+    // identity가 조상 중 하나와 같으면 (조상으로 돌아가는 심볼릭 링크) true를 반환하고 셈
+    // ancestors(visit)는 안쪽 조상부터 visit(identity)를 부르다가 visit이 true를 반환하면 멈춤
+    template <typename Ancestors>
+    bool isCycle(const DirectoryIdentity &identity, Ancestors &&ancestors) {
+      if (policy.symlinks != SymlinkPolicy::Follow || identity.second == 0) { return false; }
+      bool found = false;
+      ancestors([&](const DirectoryIdentity &ancestor) { return found = ancestor == identity; });
+      if (found) { ++stats.skippedCycles; }
+      return found;
+    }
+
+    // 디렉터리의 현재 stamp (심볼릭 링크는 따라감). 읽을 수 없으면 valid == false
+    DirectoryStamp statDirectory(const fs::path &path) {
+      DirectoryStamp result;
+      ++stats.syscalls;
+#if defined(__unix__) || defined(__APPLE__)
+      struct stat st;
+      if (stat(path.c_str(), &st) != 0) { return result; }
+#ifdef __APPLE__
+      result.mtimeNs = static_cast<long long>(st.st_mtimespec.tv_sec) * 1000000000LL + st.st_mtimespec.tv_nsec;
+#else
+      result.mtimeNs = static_cast<long long>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+#endif
+      result.inode = static_cast<unsigned long long>(st.st_ino);
+      result.device = static_cast<unsigned long long>(st.st_dev);
+#else
+      std::error_code ec;
+      auto mtime = fs::last_write_time(path, ec);
+      if (ec) { return result; }
+      result.mtimeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(mtime.time_since_epoch()).count();
+#endif
+      result.valid = true;
+      return result;
+    }
+    // path 바로 아래의 일반 파일과 디렉터리를 entries 뒤에 추가 (읽은 순서 그대로)
+    virtual void readDirectory(const fs::path &path, std::vector<ScanEntry> &entries) = 0;
+
+    // path 안의 name 하나를 readDirectory()와 같은 규칙(심볼릭 링크 정책, 크기 계산)으로 읽음 (감시자가 이벤트 하나를 반영할 때)
+    // 없거나, 일반 파일이나 디렉터리가 아니거나, 정책에 따라 빠지는 항목이면 false
+    // accounting은 일반 파일일 때 accountFile()에 그대로 넘김
+    virtual bool readEntry(const fs::path &path, std::string_view name, LinkAccounting accounting, ScanEntry &entry) {
+      fs::path entryPath = path / name;
+      ++stats.syscalls;
+#if defined(__unix__) || defined(__APPLE__)
+      struct stat st;
+      bool skipLinks = policy.symlinks == SymlinkPolicy::Skip;
+      if ((skipLinks ? lstat(entryPath.c_str(), &st) : stat(entryPath.c_str(), &st)) != 0) { return false; }
+      if (S_ISREG(st.st_mode)) {
+        entry = {std::string(name), false,
+                 accountFile(static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino),
+                             static_cast<uint64_t>(st.st_nlink), static_cast<long long>(st.st_size),
+                             static_cast<long long>(st.st_blocks), accounting)};
+      } else if (S_ISDIR(st.st_mode)) {
+        entry = {std::string(name), true, 0, static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino)};
+      } else {
+        return false;
+      }
+#else
+      std::error_code ec;
+      fs::file_status st = policy.symlinks == SymlinkPolicy::Skip ? fs::symlink_status(entryPath, ec) : fs::status(entryPath, ec);
+      if (ec) { return false; }
+      if (fs::is_regular_file(st)) {
+        uintmax_t fileSize = fs::file_size(entryPath, ec);
+        if (ec) { return false; }
+        entry = {std::string(name), false, static_cast<long long>(fileSize)};
+      } else if (fs::is_directory(st)) {
+        entry = {std::string(name), true, 0};
+      } else {
+        return false;
+      }
+#endif
+      return true;
+    }
+};
+
+// std::filesystem 기반 (이식성용)
+// directory_entry에 캐시된 파일 종류를 사용하므로 stat은 파일 크기를 얻을 때와 심볼릭 링크일 때만 호출됨
+// 디렉터리 읽기는 열기 1회로 셈 (readdir 호출 수는 라이브러리 안에 있어 알 수 없음)
+// 실제 디렉터리의 inode는 알 수 없으므로, 조상으로 돌아가는 링크는 그 링크를 한 번 더 만났을 때 멈춤
+class StdScanBackend : public ScanBackend {
+  public:
+    void readDirectory(const fs::path &path, std::vector<ScanEntry> &entries) override {
+      ++stats.directories;
+      ++stats.syscalls;
+#if defined(__unix__) || defined(__APPLE__)
+      // 하드 링크나 블록 수가 필요하면 file_size() 대신 stat 한 번으로 같이 얻음
+      bool needStat = policy.dedupHardLinks || policy.diskUsage;
+#endif
+      for (const fs::directory_entry &entry: fs::directory_iterator(path)) {
+        bool regular;
+        bool directory;
+        uint64_t device = 0;
+        uint64_t inode = 0;
+        if (entry.is_symlink()) {
+          if (policy.symlinks == SymlinkPolicy::Skip) { continue; }
+          // 링크 대상의 종류는 stat 한 번으로 얻음
+          ++stats.syscalls;
+#if defined(__unix__) || defined(__APPLE__)
+          struct stat st;
+          if (stat(entry.path().c_str(), &st) != 0) { continue; }
+          regular = S_ISREG(st.st_mode);
+          directory = S_ISDIR(st.st_mode);
+          device = static_cast<uint64_t>(st.st_dev);
+          inode = static_cast<uint64_t>(st.st_ino);
+#else
+          fs::file_status st = entry.status();
+          regular = fs::is_regular_file(st);
+          directory = fs::is_directory(st);
+#endif
+        } else {
+          regular = entry.is_regular_file();
+          directory = !regular && entry.is_directory();
+        }
+
+        if (regular) {
+          long long fileSize;
+          ++stats.syscalls;
+#if defined(__unix__) || defined(__APPLE__)
+          struct stat st;
+          if (needStat && stat(entry.path().c_str(), &st) == 0) {
+            fileSize = accountFile(static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino),
+                                   static_cast<uint64_t>(st.st_nlink), static_cast<long long>(st.st_size),
+                                   static_cast<long long>(st.st_blocks));
+          } else
+#endif
+          {
+            fileSize = static_cast<long long>(entry.file_size());
+          }
+          entries.push_back({entry.path().filename().string(), false, fileSize});
+        } else if (directory) {
+          entries.push_back({entry.path().filename().string(), true, 0, device, inode});
+        } else {
+          continue;
+        }
+        ++stats.entries;
+      }
+    }
+};
+
+#ifdef __linux__
+// getdents64가 돌려주는 항목 하나 (glibc에 선언이 없어서 직접 정의)
+struct LinuxDirent64 {
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[1];
+};
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+// POSIX 기반: 디렉터리 fd를 한 번 열고, 종류는 d_type에서, 크기는 그 fd 기준 fstatat 한 번으로 얻음
+// 즉 일반 파일 하나당 시스템 호출 1회, 하위 디렉터리는 0회 (d_type을 모르는 파일시스템이면 1회)
+class PosixScanBackend : public ScanBackend {
+  private:
+    void addEntry(int dirFd, const char *entryName, unsigned char type, uint64_t entryInode,
+                  std::vector<ScanEntry> &entries) {
+      if (entryName[0] == '.' && (entryName[1] == '\0' || (entryName[1] == '.' && entryName[2] == '\0'))) {
+        return;
+      }
+      if (type == DT_DIR) {
+        // 실제 디렉터리의 inode는 목록에 있으므로 stat 없이 순환 검사에 씀
+        entries.push_back({entryName, true, 0, 0, entryInode});
+        ++stats.entries;
+        return;
+      }
+      if (type != DT_REG && type != DT_LNK && type != DT_UNKNOWN) { return; }
+      bool skipLinks = policy.symlinks == SymlinkPolicy::Skip;
+      if (type == DT_LNK && skipLinks) { return; }
+
+      // Follow면 심볼릭 링크는 기존 스캐너처럼 대상을 따라감
+      struct stat st;
+      ++stats.syscalls;
+      if (fstatat(dirFd, entryName, &st, skipLinks ? AT_SYMLINK_NOFOLLOW : 0) != 0) { return; }
+      if (S_ISREG(st.st_mode)) {
+        entries.push_back({entryName, false,
+                           accountFile(static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino),
+                                       static_cast<uint64_t>(st.st_nlink), static_cast<long long>(st.st_size),
+                                       static_cast<long long>(st.st_blocks))});
+      } else if (S_ISDIR(st.st_mode)) {
+        entries.push_back({entryName, true, 0, static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino)});
+      } else {
+        return;
+      }
+      ++stats.entries;
+    }
+
+  public:
+    void readDirectory(const fs::path &path, std::vector<ScanEntry> &entries) override {
+      ++stats.directories;
+      ++stats.syscalls;
+      int dirFd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+      if (dirFd < 0) {
+        throw fs::filesystem_error("open", path, std::error_code(errno, std::generic_category()));
+      }
+#ifdef __linux__
+      // getdents64를 직접 호출해서 readdir 호출 수까지 정확히 셈
+      alignas(8) static thread_local char buffer[64 * 1024];
+      while (true) {
+        ++stats.syscalls;
+        long bytes = syscall(SYS_getdents64, dirFd, buffer, sizeof(buffer));
+        if (bytes < 0) {
+          int err = errno;
+          close(dirFd);
+          throw fs::filesystem_error("getdents64", path, std::error_code(err, std::generic_category()));
+        }
+        if (bytes == 0) { break; }
+        for (long offset = 0; offset < bytes;) {
+          auto *dirent = reinterpret_cast<LinuxDirent64 *>(buffer + offset);
+          addEntry(dirFd, dirent->d_name, dirent->d_type, dirent->d_ino, entries);
+          offset += dirent->d_reclen;
+        }
+      }
+      ++stats.syscalls;
+      close(dirFd);
+#else
+      DIR *dir = fdopendir(dirFd);
+      if (!dir) {
+        int err = errno;
+        close(dirFd);
+        throw fs::filesystem_error("fdopendir", path, std::error_code(err, std::generic_category()));
+      }
+      while (struct dirent *dirent = readdir(dir)) {
+        addEntry(dirFd, dirent->d_name, dirent->d_type, static_cast<uint64_t>(dirent->d_ino), entries);
+      }
+      ++stats.syscalls;
+      closedir(dir);
+#endif
+    }
+};
+#endif
+
+#ifdef __linux__
+// io_uring 기반 (Linux 5.6 이상). liburing 없이 시스템 호출과 <linux/io_uring.h>만으로 링을 다룸
+// 디렉터리 목록은 getdents64로 읽고(io_uring에는 getdents 연산이 없음), 항목들의 statx는 한꺼번에 제출해서
+// queueDepth개까지 동시에 처리되게 함. 그래서 파일이 많은 디렉터리도 시스템 호출은 io_uring_enter 몇 번으로 끝남
+// 링은 스레드마다 하나씩 빌려 쓰므로 병렬 스캐너에서도 쓸 수 있음
+class UringScanBackend : public ScanBackend {
+  private:
+    class Ring {
+      private:
+        int fd = -1;
+        unsigned entries = 0;
+        void *sqRing = MAP_FAILED;
+        void *cqRing = MAP_FAILED;
+        size_t sqRingBytes = 0;
+        size_t cqRingBytes = 0;
+        io_uring_sqe *sqes = static_cast<io_uring_sqe *>(MAP_FAILED);
+        size_t sqeBytes = 0;
+        unsigned *sqTail = nullptr;
+        unsigned *sqMask = nullptr;
+        unsigned *sqArray = nullptr;
+        unsigned *cqHead = nullptr;
+        unsigned *cqTail = nullptr;
+        unsigned *cqMask = nullptr;
+        io_uring_cqe *cqes = nullptr;
+        unsigned unsubmitted = 0;  // 넣었지만 커널이 아직 가져가지 않은 요청
+        unsigned running = 0;      // 커널이 가져갔지만 완료를 아직 거두지 않은 요청
+
+        static unsigned *field(void *base, unsigned offset) {
+          return reinterpret_cast<unsigned *>(static_cast<char *>(base) + offset);
+        }
+        [[noreturn]] static void fail(const char *what) { throw std::system_error(errno, std::generic_category(), what); }
+
+        // 매핑과 fd를 놓음 (여러 번 불러도 됨)
+        void unmap() noexcept {
+          if (sqes != MAP_FAILED) { munmap(sqes, sqeBytes); }
+          if (cqRing != MAP_FAILED && cqRing != sqRing) { munmap(cqRing, cqRingBytes); }
+          if (sqRing != MAP_FAILED) { munmap(sqRing, sqRingBytes); }
+          if (fd >= 0) { close(fd); }
+          sqes = static_cast<io_uring_sqe *>(MAP_FAILED);
+          cqRing = sqRing = MAP_FAILED;
+          fd = -1;
+        }
+        // 생성 도중의 실패: 소멸자가 불리지 않으므로 이미 만든 fd와 매핑을 놓고 던짐
+        [[noreturn]] void setupFailed(const char *what) {
+          int err = errno;
+          unmap();
+          throw std::system_error(err, std::generic_category(), what);
+        }
+
+      public:
+        explicit Ring(unsigned depth) {
+          io_uring_params params{};
+          fd = static_cast<int>(syscall(__NR_io_uring_setup, depth, &params));
+          if (fd < 0) { fail("io_uring_setup"); }
+          entries = params.sq_entries;
+          sqRingBytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+          cqRingBytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+          bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+          if (single) { sqRingBytes = cqRingBytes = std::max(sqRingBytes, cqRingBytes); }
+          sqRing = mmap(nullptr, sqRingBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+          if (sqRing == MAP_FAILED) { setupFailed("mmap sq ring"); }
+          cqRing = single ? sqRing
+                          : mmap(nullptr, cqRingBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+          if (cqRing == MAP_FAILED) { setupFailed("mmap cq ring"); }
+          sqeBytes = params.sq_entries * sizeof(io_uring_sqe);
+          sqes = static_cast<io_uring_sqe *>(
+              mmap(nullptr, sqeBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+          if (sqes == MAP_FAILED) { setupFailed("mmap sqes"); }
+          sqTail = field(sqRing, params.sq_off.tail);
+          sqMask = field(sqRing, params.sq_off.ring_mask);
+          sqArray = field(sqRing, params.sq_off.array);
+          cqHead = field(cqRing, params.cq_off.head);
+          cqTail = field(cqRing, params.cq_off.tail);
+          cqMask = field(cqRing, params.cq_off.ring_mask);
+          cqes = reinterpret_cast<io_uring_cqe *>(static_cast<char *>(cqRing) + params.cq_off.cqes);
+        }
+        Ring(const Ring &) = delete;
+        Ring &operator=(const Ring &) = delete;
+        ~Ring() { unmap(); }
+
+        unsigned capacity() const { return entries; }
+        // 넣은 뒤 완료를 아직 거두지 않은 요청 수
+        unsigned inFlight() const { return unsubmitted + running; }
+
+        // statx(dirFd, name) 요청 하나를 제출 큐에 넣음 (io_uring_enter를 부르기 전까지는 커널에 안 넘어감)
+        void queueStatx(int dirFd, const char *name, struct statx *result, uint64_t tag, bool followLinks) {
+          unsigned tail = *sqTail;
+          unsigned index = tail & *sqMask;
+          io_uring_sqe &sqe = sqes[index];
+          std::memset(&sqe, 0, sizeof(sqe));
+          sqe.opcode = IORING_OP_STATX;
+          sqe.fd = dirFd;
+          sqe.addr = reinterpret_cast<uint64_t>(name);
+          sqe.len = STATX_TYPE | STATX_SIZE | STATX_INO | STATX_NLINK | STATX_BLOCKS;
+          sqe.off = reinterpret_cast<uint64_t>(result);
+          sqe.statx_flags = followLinks ? 0 : AT_SYMLINK_NOFOLLOW;
+          sqe.user_data = tag;
+          sqArray[index] = index;
+          __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+          ++unsubmitted;
+        }
+
+        // 넣어 둔 요청을 제출하고 적어도 waitFor개가 끝날 때까지 기다림
+        void enter(unsigned waitFor) {
+          while (true) {
+            long done = syscall(__NR_io_uring_enter, fd, unsubmitted, waitFor, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (done >= 0) {
+              unsubmitted -= static_cast<unsigned>(done);
+              running += static_cast<unsigned>(done);
+              return;
+            }
+            if (errno != EINTR) { fail("io_uring_enter"); }
+          }
+        }
+
+        // 커널이 가져간 요청이 모두 끝날 때까지 기다리고 완료는 버림 (예외 경로용, 요청이 가리키는 버퍼를 놓기 전에 부름)
+        // 기다리지 못했으면 false. 제출되지 않고 남은 요청은 실행되지 않으므로 이후 이 링은 버려야 함
+        bool drain() noexcept {
+          while (running > 0) {
+            long done = syscall(__NR_io_uring_enter, fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (done < 0 && errno != EINTR) { return false; }
+            reap([](uint64_t, int) {});
+          }
+          return true;
+        }
+
+        // 끝난 요청마다 complete(tag, res) 호출하고 처리한 개수 반환
+        template <typename Complete>
+        unsigned reap(Complete &&complete) {
+          unsigned head = *cqHead;
+          unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+          unsigned count = 0;
+          for (; head != tail; ++head, ++count) {
+            const io_uring_cqe &cqe = cqes[head & *cqMask];
+            complete(cqe.user_data, cqe.res);
+          }
+          __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+          running -= count;
+          return count;
+        }
+    };
+
+    // 목록에서 읽은 이름 하나 (하위 디렉터리가 아니면 statx로 종류와 크기를 얻음)
+    struct Pending {
+      std::string name;
+      bool knownDirectory;
+      uint64_t inode;
+    };
+    // drain()조차 실패해서 요청이 끝났는지 모르는 링과, 그 요청이 가리키는 버퍼
+    struct AbandonedRing {
+      std::unique_ptr<Ring> ring;
+      std::vector<struct statx> results;
+      std::vector<Pending> listed;
+    };
+    // 커널이 나중에라도 쓸 수 있는 메모리를 해제하지 않도록 프로그램이 끝날 때까지 두는 곳 (graveyard)
+    // 일부러 소멸시키지 않음 (종료 중에 링을 닫기 전에 버퍼를 놓을 수 있으므로). fd가 망가져야 생기는 일이라 거의 비어 있음
+    // 넣을 자리도 못 만들면 버퍼를 해제하는 대신 종료함 (noexcept)
+    static void abandon(std::unique_ptr<Ring> &ring, std::vector<struct statx> &results, std::vector<Pending> &listed) noexcept {
+      static std::mutex graveyardLock;
+      static auto *graveyard = new std::vector<AbandonedRing>();
+      std::lock_guard<std::mutex> guard(graveyardLock);
+      graveyard->push_back({std::move(ring), std::move(results), std::move(listed)});
+    }
+
+    unsigned queueDepth;
+    std::mutex ringsLock;
+    std::vector<std::unique_ptr<Ring>> idleRings;  // 지금 아무도 쓰지 않는 링
+
+    std::unique_ptr<Ring> acquireRing() {
+      {
+        std::lock_guard<std::mutex> guard(ringsLock);
+        if (!idleRings.empty()) {
+          std::unique_ptr<Ring> ring = std::move(idleRings.back());
+          idleRings.pop_back();
+          return ring;
+        }
+      }
+      return std::make_unique<Ring>(queueDepth);
+    }
+    void releaseRing(std::unique_ptr<Ring> ring) {
+      std::lock_guard<std::mutex> guard(ringsLock);
+      idleRings.push_back(std::move(ring));
+    }
+
+  public:
+    // 링을 하나 만들어 봐서 io_uring을 쓸 수 없으면 여기서 std::system_error를 던짐
+    explicit UringScanBackend(unsigned depth = 256): queueDepth(std::max(1u, depth)) {
+      idleRings.push_back(std::make_unique<Ring>(queueDepth));
+    }
+
+    void readDirectory(const fs::path &path, std::vector<ScanEntry> &entries) override {
+      ++stats.directories;
+      ++stats.syscalls;
+      int dirFd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+      if (dirFd < 0) {
+        throw fs::filesystem_error("open", path, std::error_code(errno, std::generic_category()));
+      }
+
+      // 1) 목록: 하위 디렉터리는 바로 알고, 나머지는 statx가 필요한 이름으로 모음
+      bool followLinks = policy.symlinks == SymlinkPolicy::Follow;
+      std::vector<Pending> listed;
+      alignas(8) static thread_local char buffer[64 * 1024];
+      while (true) {
+        ++stats.syscalls;
+        long bytes = syscall(SYS_getdents64, dirFd, buffer, sizeof(buffer));
+        if (bytes < 0) {
+          int err = errno;
+          close(dirFd);
+          throw fs::filesystem_error("getdents64", path, std::error_code(err, std::generic_category()));
+        }
+        if (bytes == 0) { break; }
+        for (long offset = 0; offset < bytes;) {
+          auto *dirent = reinterpret_cast<LinuxDirent64 *>(buffer + offset);
+          offset += dirent->d_reclen;
+          const char *entryName = dirent->d_name;
+          if (entryName[0] == '.' && (entryName[1] == '\0' || (entryName[1] == '.' && entryName[2] == '\0'))) { continue; }
+          unsigned char type = dirent->d_type;
+          if (type != DT_DIR && type != DT_REG && type != DT_LNK && type != DT_UNKNOWN) { continue; }
+          if (type == DT_LNK && !followLinks) { continue; }
+          listed.push_back({entryName, type == DT_DIR, dirent->d_ino});
+        }
+      }
+
+      // 2) statx를 queueDepth개까지 겹쳐서 처리 (끝나는 대로 다음 요청을 채워 넣음)
+      std::vector<struct statx> results(listed.size());
+      std::vector<int> status(listed.size(), 0);
+      std::unique_ptr<Ring> ring;
+      try {
+        ring = acquireRing();
+        size_t next = 0;
+        auto skipKnown = [&] {
+          while (next < listed.size() && listed[next].knownDirectory) { ++next; }
+        };
+        skipKnown();
+        while (next < listed.size() || ring->inFlight() > 0) {
+          while (next < listed.size() && ring->inFlight() < ring->capacity()) {
+            ring->queueStatx(dirFd, listed[next].name.c_str(), &results[next], next, followLinks);
+            ++next;
+            skipKnown();
+          }
+          ++stats.syscalls;
+          ring->enter(1);
+          ring->reap([&status](uint64_t tag, int res) { status[tag] = res; });
+        }
+      } catch (...) {
+        // 제출한 statx가 아직 results와 listed의 이름을 쓰고 읽을 수 있으므로 모두 끝난 뒤에 나감
+        // 남은 요청이 있을 수 있는 링은 풀에 돌려주지 않고 닫음. 기다리지도 못했으면 링과 버퍼를 abandon()에 넘김
+        // (vector를 옮겨도 원소의 주소는 그대로이므로 요청이 가리키는 곳이 유지됨)
+        if (ring && !ring->drain()) { abandon(ring, results, listed); }
+        ring.reset();
+        close(dirFd);
+        throw;
+      }
+      releaseRing(std::move(ring));
+      ++stats.syscalls;
+      close(dirFd);
+
+      for (size_t i = 0; i < listed.size(); ++i) {
+        const struct statx &st = results[i];
+        uint64_t device = static_cast<uint64_t>(makedev(st.stx_dev_major, st.stx_dev_minor));
+        if (listed[i].knownDirectory) {
+          entries.push_back({std::move(listed[i].name), true, 0, 0, listed[i].inode});
+        } else if (status[i] != 0) {
+          continue;
+        } else if (S_ISREG(st.stx_mode)) {
+          entries.push_back({std::move(listed[i].name), false,
+                             accountFile(device, st.stx_ino, st.stx_nlink, static_cast<long long>(st.stx_size),
+                                         static_cast<long long>(st.stx_blocks))});
+        } else if (S_ISDIR(st.stx_mode)) {
+          entries.push_back({std::move(listed[i].name), true, 0, device, st.stx_ino});
+        } else {
+          continue;
+        }
+        ++stats.entries;
+      }
+    }
+};
+#endif
+
+// 이름이 "std", "posix", "uring"인 백엔드 생성. 알 수 없는 이름이면 nullptr
+// "uring"은 io_uring을 쓸 수 없으면 std::system_error를 던짐 (queueDepth는 "uring"만 사용)
+std::unique_ptr<ScanBackend> makeScanBackend(const std::string &kind, unsigned queueDepth = 256) {
+  if (kind == "std") { return std::make_unique<StdScanBackend>(); }
+#if defined(__unix__) || defined(__APPLE__)
+  if (kind == "posix") { return std::make_unique<PosixScanBackend>(); }
+#endif
+#ifdef __linux__
+  if (kind == "uring") { return std::make_unique<UringScanBackend>(queueDepth); }
+#else
+  (void)queueDepth;
+#endif
+  return nullptr;
+}
+
+// 미리 컴파일한 이름 glob ('*', '?', "[abc]", "[a-z]", "[!x]"). 경로가 아니라 이름 전체와 맞춰 봄
+// 흔한 모양(".git", "*.log", "build*")은 문자열 비교 한 번으로 끝나고, 나머지만 일반 매칭을 함
+class NameGlob {
+  private:
+    enum class Kind { Exact, Prefix, Suffix, General };
+    Kind kind = Kind::General;
+    std::string literal;  // Exact/Prefix/Suffix의 고정 부분
+    std::string pattern;
+
+    // pattern[p]에서 시작하는 "[...]"가 c와 맞는지. end에 ']' 다음 위치를 돌려줌 (']'가 없으면 '['를 글자로 봄)
+    bool matchClass(size_t p, char c, size_t &end) const {
+      size_t i = p + 1;
+      bool negate = i < pattern.size() && (pattern[i] == '!' || pattern[i] == '^');
+      if (negate) { ++i; }
+      bool matched = false;
+      bool first = true;
+      for (; i < pattern.size() && (first || pattern[i] != ']'); ++i, first = false) {
+        if (i + 2 < pattern.size() && pattern[i + 1] == '-' && pattern[i + 2] != ']') {
+          if (pattern[i] <= c && c <= pattern[i + 2]) { matched = true; }
+          i += 2;
+        } else if (pattern[i] == c) {
+          matched = true;
+        }
+      }
+      if (i >= pattern.size()) {
+        end = p + 1;
+        return c == '[';
+      }
+      end = i + 1;
+      return matched != negate;
+    }
+
+    // '*'에서 되돌아가는 방식 (되돌아갈 곳은 마지막 '*' 하나뿐이라 최악에도 O(이름 * 패턴))
+    bool matchGeneral(std::string_view name) const {
+      size_t p = 0;
+      size_t n = 0;
+      size_t starP = std::string::npos;
+      size_t starN = 0;
+      while (n < name.size()) {
+        size_t next = p + 1;
+        if (p < pattern.size() && pattern[p] == '*') {
+          starP = p++;
+          starN = n;
+          continue;
+        }
+        if (p < pattern.size() &&
+            (pattern[p] == '?' || (pattern[p] == '[' ? matchClass(p, name[n], next) : pattern[p] == name[n]))) {
+          p = next;
+          ++n;
+          continue;
+        }
+        if (starP == std::string::npos) { return false; }
+        p = starP + 1;
+        n = ++starN;
+      }
+      while (p < pattern.size() && pattern[p] == '*') { ++p; }
+      return p == pattern.size();
+    }
+
+  public:
+    explicit NameGlob(std::string glob): pattern(std::move(glob)) {
+      auto special = [](char c) { return c == '*' || c == '?' || c == '['; };
+      size_t count = static_cast<size_t>(std::count_if(pattern.begin(), pattern.end(), special));
+      if (count == 0) {
+        kind = Kind::Exact;
+        literal = pattern;
+      } else if (count == 1 && pattern.front() == '*') {
+        kind = Kind::Suffix;
+        literal = pattern.substr(1);
+      } else if (count == 1 && pattern.back() == '*') {
+        kind = Kind::Prefix;
+        literal = pattern.substr(0, pattern.size() - 1);
+      }
+    }
+
+    bool matches(std::string_view name) const {
+      switch (kind) {
+        case Kind::Exact: return name == literal;
+        case Kind::Prefix: return name.substr(0, literal.size()) == literal;
+        case Kind::Suffix:
+          return name.size() >= literal.size() && name.substr(name.size() - literal.size()) == literal;
+        case Kind::General: break;
+      }
+      return matchGeneral(name);
+    }
+};
+
+// 스캔 필터 규칙 (파일과 디렉터리 이름에 적용)
+//   exclude(Globs/Regexes): 맞는 파일은 빼고, 맞는 디렉터리는 열지도 않음
+//   include(Globs/Regexes): 하나라도 있으면 어느 것과도 맞지 않는 파일을 뺌 (디렉터리는 안쪽 파일을 찾으려고 그대로 들어감)
+//   minFileSize: 이보다 작은 파일을 뺌 (policy대로 센 크기 기준)
+//   oneFileSystem: 스캔 중에 만난 다른 파일시스템의 마운트 지점은 열지 않음
+struct ScanFilter {
+  std::vector<std::string> includeGlobs;
+  std::vector<std::string> excludeGlobs;
+  std::vector<std::string> includeRegexes;
+  std::vector<std::string> excludeRegexes;
+  long long minFileSize = 0;
+  bool oneFileSystem = false;
+
+  bool empty() const {
+    return includeGlobs.empty() && excludeGlobs.empty() && includeRegexes.empty() && excludeRegexes.empty() &&
+           minFileSize <= 0 && !oneFileSystem;
+  }
+};
+
+// 읽은 항목에 ScanFilter를 적용하는 backend. 빠진 디렉터리는 스캐너에 알려지지 않으므로 열리지 않음
+// 패턴은 생성할 때 한 번만 컴파일함 (정규식이 잘못되었으면 std::regex_error)
+class FilteredScanBackend : public ScanBackend {
+  private:
+    ScanBackend &inner;
+    std::vector<NameGlob> includeGlobs;
+    std::vector<NameGlob> excludeGlobs;
+    std::vector<std::regex> includeRegexes;
+    std::vector<std::regex> excludeRegexes;
+    long long minFileSize;
+    bool oneFileSystem;
+#ifdef __linux__
+    fs::path workingDirectory;
+    std::unordered_set<std::string> mountPoints;  // 정규화한 절대 경로
+
+    // /proc/self/mountinfo의 다섯째 칸 (공백 등은 \ooo로 적혀 있음)
+    void loadMountPoints() {
+      std::ifstream in("/proc/self/mountinfo");
+      std::string line;
+      while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string field;
+        for (int i = 0; i < 5 && fields >> field; ++i) {}
+        std::string decoded;
+        for (size_t i = 0; i < field.size(); ++i) {
+          if (field[i] == '\\' && i + 3 < field.size()) {
+            decoded.push_back(static_cast<char>(std::stoi(field.substr(i + 1, 3), nullptr, 8)));
+            i += 3;
+          } else {
+            decoded.push_back(field[i]);
+          }
+        }
+        if (decoded != "/") { mountPoints.insert(std::move(decoded)); }
+      }
+    }
+#endif
+
+    template <typename Pattern>
+    static bool anyMatch(const std::vector<Pattern> &patterns, const std::string &name) {
+      for (const Pattern &pattern: patterns) {
+        if constexpr (std::is_same_v<Pattern, std::regex>) {
+          if (std::regex_search(name, pattern)) { return true; }
+        } else {
+          if (pattern.matches(name)) { return true; }
+        }
+      }
+      return false;
+    }
+
+    bool keep(const ScanEntry &entry) const {
+      if (anyMatch(excludeGlobs, entry.name) || anyMatch(excludeRegexes, entry.name)) { return false; }
+      if (entry.isDirectory) { return true; }
+      if (entry.size < minFileSize) { return false; }
+      if (includeGlobs.empty() && includeRegexes.empty()) { return true; }
+      return anyMatch(includeGlobs, entry.name) || anyMatch(includeRegexes, entry.name);
+    }
+
+    // path 바로 아래의 항목이 다른 파일시스템의 마운트 지점인지 보는 함수 (oneFileSystem일 때만 부름)
+    // 마운트 목록과 경로로 비교 (Linux), 그 밖에서는 디렉터리마다 stat으로 장치를 비교
+    auto mountCheck(const fs::path &path) {
+#ifdef __linux__
+      std::string prefix = (workingDirectory / path).lexically_normal().string();
+      if (prefix.empty() || prefix.back() != '/') { prefix.push_back('/'); }
+      return [this, prefix = std::move(prefix)](const ScanEntry &entry) { return mountPoints.count(prefix + entry.name) != 0; };
+#else
+      DirectoryStamp here = statDirectory(path);
+      return [this, path, here](const ScanEntry &entry) { return statDirectory(path / entry.name).device != here.device; };
+#endif
+    }
+
+  public:
+    FilteredScanBackend(ScanBackend &b, const ScanFilter &rules)
+        : ScanBackend(b), inner(b), minFileSize(rules.minFileSize), oneFileSystem(rules.oneFileSystem) {
+      for (const std::string &glob: rules.includeGlobs) { includeGlobs.emplace_back(glob); }
+      for (const std::string &glob: rules.excludeGlobs) { excludeGlobs.emplace_back(glob); }
+      for (const std::string &re: rules.includeRegexes) { includeRegexes.emplace_back(re, std::regex::optimize); }
+      for (const std::string &re: rules.excludeRegexes) { excludeRegexes.emplace_back(re, std::regex::optimize); }
+#ifdef __linux__
+      if (oneFileSystem) {
+        workingDirectory = fs::current_path();
+        loadMountPoints();
+      }
+#endif
+    }
+
+    void readDirectory(const fs::path &path, std::vector<ScanEntry> &entries) override {
+      size_t first = entries.size();
+      inner.readDirectory(path, entries);
+      if (first == entries.size()) { return; }
+      std::optional<decltype(mountCheck(path))> crossesMount;
+      if (oneFileSystem) { crossesMount.emplace(mountCheck(path)); }
+      auto end = std::remove_if(entries.begin() + static_cast<std::ptrdiff_t>(first), entries.end(),
+                                [&](const ScanEntry &entry) {
+                                  bool drop = !keep(entry) || (crossesMount && entry.isDirectory && (*crossesMount)(entry));
+                                  if (drop) { ++stats.filteredOut; }
+                                  return drop;
+                                });
+      entries.erase(end, entries.end());
+    }
+
+    bool readEntry(const fs::path &path, std::string_view name, LinkAccounting accounting, ScanEntry &entry) override {
+      if (!inner.readEntry(path, name, accounting, entry)) { return false; }
+      if (keep(entry) && !(oneFileSystem && entry.isDirectory && mountCheck(path)(entry))) { return true; }
+      ++stats.filteredOut;
+      return false;
+    }
+};
+
+// 깊이 제한 아래 하위 트리의 합계 (노드는 만들지 않음). 필터, 크기 계산, 순환 검사는 backend를 그대로 따름
+// outer(visit)는 path 바깥의 조상들을 순환 검사에 알려 줌
+struct SubtreeTotals {
+  long long size = 0;
+  long long files = 0;
+  long long dirs = 0;
+};
+
+template <typename Ancestors>
+SubtreeTotals countSubtree(const fs::path &path, DirectoryIdentity identity, ScanBackend &backend, Ancestors &&outer) {
+  struct Frame {
+    fs::path path;
+    std::vector<ScanEntry> entries;
+    size_t next;
+    DirectoryIdentity identity;
+  };
+  SubtreeTotals totals;
+  std::vector<Frame> stack;
+  stack.push_back({path, {}, 0, identity});
+  backend.readDirectory(path, stack.back().entries);
+  auto ancestors = [&stack, &outer](auto &&visit) {
+    for (auto frame = stack.rbegin(); frame != stack.rend(); ++frame) {
+      if (visit(frame->identity)) { return; }
+    }
+    outer(visit);
+  };
+  while (!stack.empty()) {
+    Frame &top = stack.back();
+    if (top.next == top.entries.size()) {
+      stack.pop_back();
+      continue;
+    }
+    ScanEntry &entry = top.entries[top.next++];
+    if (!entry.isDirectory) {
+      totals.size += entry.size;
+      ++totals.files;
+      continue;
+    }
+    ++totals.dirs;
+    DirectoryIdentity childIdentity = ScanBackend::childIdentity(top.identity, entry);
+    if (backend.isCycle(childIdentity, ancestors)) { continue; }
+    fs::path subPath = top.path / entry.name;
+    stack.push_back({std::move(subPath), {}, 0, childIdentity});
+    backend.readDirectory(stack.back().path, stack.back().entries);
+  }
+  return totals;
+}
+
+// 디렉터리 단위 DFS. 재귀 대신 명시적 스택을 쓰므로 깊이 제한이 없음
+void buildFileststemTree(const fs::path &currentPath, Directory *parentDir, ScanBackend &backend) {
+  if (!parentDir) return;
+
+  struct Frame {
+    Directory *dir;
+    ComponentPtr owner;  // 아직 부모에 붙지 않은 디렉터리 (시작 디렉터리는 nullptr)
+    fs::path path;
+    std::vector<ScanEntry> entries;
+    size_t next;
+    DirectoryIdentity identity;
+  };
+  FS_PHASE_SCOPE(InstrumentPhase::Scan);
+  std::vector<Frame> stack;
+  stack.push_back({parentDir, nullptr, currentPath, {}, 0, backend.rootIdentity(currentPath)});
+  auto ancestors = [&stack](auto &&visit) {
+    for (auto frame = stack.rbegin(); frame != stack.rend() && !visit(frame->identity); ++frame) {}
+  };
+  int maxDepth = backend.policy.maxDepth;
+  if (maxDepth == 0) {
+    SubtreeTotals totals = countSubtree(currentPath, stack.back().identity, backend, [](auto &&) {});
+    parentDir->setCollapsed(totals.size, totals.files, totals.dirs);
+    return;
+  }
+  {
+    FS_DIRECTORY_SCOPE(currentPath, 0, stack.back().entries);
+    backend.readDirectory(currentPath, stack.back().entries);
+  }
+  parentDir->reserve(parentDir->getChildren().size() + stack.back().entries.size());
+
+  while (!stack.empty()) {
+    Frame &top = stack.back();
+    if (top.next == top.entries.size()) {
+      // 하위 트리를 다 채운 뒤 추가해야 합계 전파가 한 번으로 끝남
+      ComponentPtr done = std::move(top.owner);
+      stack.pop_back();
+      if (!stack.empty()) { stack.back().dir->add(std::move(done)); }
+      continue;
+    }
+    ScanEntry &entry = top.entries[top.next++];
+    if (!entry.isDirectory) {
+      top.dir->add(top.dir->createFile(std::move(entry.name), entry.size));
+      continue;
+    }
+    DirectoryIdentity identity = ScanBackend::childIdentity(top.identity, entry);
+    if (backend.isCycle(identity, ancestors)) {
+      // 조상으로 돌아가는 링크는 따라가지 않고 빈 디렉터리로 남김
+      top.dir->add(top.dir->createDirectory(std::move(entry.name)));
+      continue;
+    }
+    fs::path subPath = top.path / entry.name;
+    DirectoryPtr subDir = top.dir->createDirectory(std::move(entry.name));
+    if (maxDepth > 0 && static_cast<int>(stack.size()) >= maxDepth) {
+      // 깊이 제한: 하위를 읽어 합계만 두고 노드는 만들지 않음
+      SubtreeTotals totals = countSubtree(subPath, identity, backend, ancestors);
+      subDir->setCollapsed(totals.size, totals.files, totals.dirs);
+      top.dir->add(std::move(subDir));
+      continue;
+    }
+    Directory *dir = subDir.get();
+    stack.push_back({dir, std::move(subDir), std::move(subPath), {}, 0, identity});
+    FS_DIRECTORY_SCOPE(stack.back().path, static_cast<int>(stack.size() - 1), stack.back().entries);
+    backend.readDirectory(stack.back().path, stack.back().entries);
+    dir->reserve(stack.back().entries.size());
+  }
+}
+
+void buildFileststemTree(const fs::path &currentPath, Directory *parentDir, bool isRoot = false) {
+  StdScanBackend backend;
+  buildFileststemTree(currentPath, parentDir, backend);
+}
+
+// 이전 스냅샷의 트리를 현재 상태로 갱신하는 증분 스캐너
+// 디렉터리마다 stamp(mtime, inode)를 비교해서 같으면 파일 목록과 크기를 그대로 두고 하위 디렉터리만 확인함
+// 바뀐 디렉터리만 다시 읽고, 이름과 종류가 같은 기존 노드는 새로 만들지 않고 재사용함
+// 디렉터리 mtime은 항목이 추가/삭제/이름 변경될 때만 바뀌므로, 내용만 바뀐 파일의 크기는 갱신되지 않음
+// 항목은 backend로 읽으므로 필터, 샤드 경계, 심볼릭 링크 정책이 그대로 적용됨 (조상으로 돌아가는 링크는 빈 디렉터리로 남김)
+// 재사용한 디렉터리의 파일은 inode를 모르므로 policy.dedupHardLinks와 policy.maxDepth는 지원하지 않음 (invalid_argument)
+class IncrementalScanner {
+  private:
+    ScanBackend &backend;
+  public:
+    long long reusedDirectories = 0;
+    long long rescannedDirectories = 0;
+
+    explicit IncrementalScanner(ScanBackend &b): backend(b) {
+      if (backend.policy.dedupHardLinks || backend.policy.maxDepth >= 0) {
+        throw std::invalid_argument("incremental scan does not support hard-link dedup or a depth limit");
+      }
+    }
+
+    // root(이전 결과, 처음이면 빈 디렉터리)를 rootPath의 현재 상태로 맞춤
+    void rescan(const fs::path &rootPath, Directory &root) {
+      std::vector<std::pair<Directory *, fs::path>> pending;
+      pending.emplace_back(&root, rootPath);
+      while (!pending.empty()) {
+        Directory *dir = pending.back().first;
+        fs::path path = std::move(pending.back().second);
+        pending.pop_back();
+
+        DirectoryStamp current = backend.statDirectory(path);
+        // 조상의 stamp는 이미 이번 상태로 맞춰져 있음
+        auto ancestors = [dir](auto &&visit) {
+          for (const Directory *up = dir->getParent(); up && !visit(DirectoryIdentity(up->getStamp().device, up->getStamp().inode));
+               up = up->getParent()) {}
+        };
+        if (current.valid && dir != &root && backend.isCycle({current.device, current.inode}, ancestors)) {
+          dir->takeChildren();
+          dir->setStamp(DirectoryStamp());
+          continue;
+        }
+        if (current.valid && current == dir->getStamp()) {
+          ++reusedDirectories;
+          for (FilesystemComponent *child: dir->getChildren()) {
+            if (child->isDirectory()) { pending.emplace_back(static_cast<Directory *>(child), path / child->getNameView()); }
+          }
+          continue;
+        }
+
+        ++rescannedDirectories;
+        std::vector<ComponentPtr> previous = dir->takeChildren();
+        std::unordered_map<std::string_view, size_t> previousByName;
+        for (size_t i = 0; i < previous.size(); ++i) { previousByName.emplace(previous[i]->getNameView(), i); }
+
+        std::vector<ScanEntry> entries;
+        backend.readDirectory(path, entries);
+        dir->reserve(entries.size());
+        for (ScanEntry &entry: entries) {
+          ComponentPtr node;
+          auto found = previousByName.find(entry.name);
+          if (found != previousByName.end() && previous[found->second] &&
+              previous[found->second]->isDirectory() == entry.isDirectory) {
+            node = std::move(previous[found->second]);
+            if (!entry.isDirectory) { static_cast<File &>(*node).setSize(entry.size); }
+          } else if (entry.isDirectory) {
+            node = dir->createDirectory(entry.name);
+          } else {
+            node = dir->createFile(entry.name, entry.size);
+          }
+          FilesystemComponent *child = node.get();
+          dir->add(std::move(node));
+          if (entry.isDirectory) { pending.emplace_back(static_cast<Directory *>(child), path / entry.name); }
+        }
+        dir->setStamp(current);
+        // previous에 남은 노드는 없어진 항목이므로 여기서 해제됨
+      }
+    }
+};
+
+#ifdef __linux__
+// inotify로 스캔한 트리를 계속 최신 상태로 유지하는 감시자
+// 생성/삭제/이름 변경/크기 변경 이벤트를 해당 노드에 바로 반영하므로 상위 합계도 함께 갱신됨
+// 같은 트리 안에서의 이름 변경은 노드를 옮기기만 하고 다시 읽지 않음
+// 심볼릭 링크 자체가 아니라 링크 대상이 바뀐 경우는 이벤트가 없으므로 반영되지 않음
+// 하드 링크 중복(dedupHardLinks)은 스캔과 같은 inode 집합으로 판정하고, 이미 있는 노드는 처음 정한 쪽(센 것/0)을 유지함
+// 단 이벤트는 바뀐 이름에만 오므로 다른 이름의 노드 크기, 센 링크가 지워진 뒤의 나머지 링크,
+// 감시 중에 두 번째 링크가 생긴 파일(링크가 하나일 때는 집합에 넣지 않음)은 큐가 넘쳐 다시 읽을 때까지 어긋날 수 있음
+class TreeWatcher {
+  private:
+    static constexpr uint32_t watchMask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY |
+                                          IN_CLOSE_WRITE | IN_DELETE_SELF | IN_ONLYDIR;
+    Directory &root;
+    fs::path rootPath;
+    ScanBackend &backend;
+    int fd = -1;
+    std::unordered_map<int, Directory *> directoryByWatch;
+    std::unordered_map<const Directory *, int> watchByDirectory;
+    // IN_MOVED_FROM으로 떼어 낸 뒤 같은 cookie의 IN_MOVED_TO를 기다리는 노드
+    std::unordered_map<uint32_t, ComponentPtr> pendingMoves;
+
+    fs::path pathOf(const Directory *dir) const {
+      std::vector<std::string_view> names;
+      for (const Directory *d = dir; d && d != &root; d = d->getParent()) { names.push_back(d->getNameView()); }
+      fs::path result = rootPath;
+      for (auto it = names.rbegin(); it != names.rend(); ++it) { result /= *it; }
+      return result;
+    }
+
+    // 이미 감시 중인 디렉터리에 다시 걸면 같은 wd가 나오므로 여러 번 불러도 됨
+    bool watch(Directory &dir) {
+      int wd = inotify_add_watch(fd, pathOf(&dir).c_str(), watchMask);
+      if (wd < 0) {
+        // 감시를 걸기 전에 없어진 디렉터리는 곧 삭제 이벤트가 오므로 무시
+        if (errno == ENOENT || errno == ENOTDIR) { return false; }
+        throw std::system_error(errno, std::generic_category(), "inotify_add_watch " + pathOf(&dir).string());
+      }
+      directoryByWatch[wd] = &dir;
+      watchByDirectory[&dir] = wd;
+      return true;
+    }
+
+    void watchSubtree(Directory &top) {
+      traverseTree(top, [this](FilesystemComponent &node, int) {
+        return node.isDirectory() && watch(static_cast<Directory &>(node));
+      });
+    }
+
+    // top 아래를 읽어 트리에 맞춤. 디렉터리마다 감시를 먼저 건 다음 읽어야 그 사이에 생긴 항목을 놓치지 않음
+    // 그 사이의 IN_CREATE로 이미 들어온 항목은 이름으로 찾아 갱신하므로 겹쳐 와도 중복되지 않음
+    void scanWatched(Directory &top) {
+      struct Frame {
+        Directory *dir;
+        std::vector<ScanEntry> entries;
+        size_t next;
+        DirectoryIdentity identity;
+      };
+      std::vector<Frame> stack;
+      auto open = [&](Directory &dir, const DirectoryIdentity &identity) {
+        if (!watch(dir)) { return; }
+        stack.push_back({&dir, {}, 0, identity});
+        backend.readDirectory(pathOf(&dir), stack.back().entries);
+      };
+      auto ancestors = [&stack](auto &&visit) {
+        for (auto frame = stack.rbegin(); frame != stack.rend() && !visit(frame->identity); ++frame) {}
+      };
+      open(top, backend.rootIdentity(pathOf(&top)));
+      while (!stack.empty()) {
+        Frame &frame = stack.back();
+        if (frame.next == frame.entries.size()) {
+          stack.pop_back();
+          continue;
+        }
+        ScanEntry &entry = frame.entries[frame.next++];
+        Directory &dir = *frame.dir;
+        FilesystemComponent *existing = dir.findChild(entry.name);
+        if (existing && existing->isDirectory() != entry.isDirectory) {
+          discard(dir.remove(existing));
+          existing = nullptr;
+        }
+        if (!entry.isDirectory) {
+          if (existing) {
+            static_cast<File *>(existing)->setSize(entry.size);
+          } else {
+            dir.add(dir.createFile(std::move(entry.name), entry.size));
+          }
+          continue;
+        }
+        DirectoryIdentity identity = ScanBackend::childIdentity(frame.identity, entry);
+        Directory *subDir = static_cast<Directory *>(existing);
+        if (!subDir) {
+          DirectoryPtr created = dir.createDirectory(std::move(entry.name));
+          subDir = created.get();
+          dir.add(std::move(created));
+        }
+        // 조상으로 돌아가는 링크는 빈 디렉터리로 남기고 감시하지 않음 (같은 wd가 나와 조상을 덮어씀)
+        if (backend.isCycle(identity, ancestors)) { continue; }
+        open(*subDir, identity);
+      }
+    }
+
+    void unwatchSubtree(FilesystemComponent &top) {
+      traverseTree(top, [this](FilesystemComponent &node, int) {
+        if (!node.isDirectory()) { return false; }
+        auto found = watchByDirectory.find(static_cast<Directory *>(&node));
+        if (found != watchByDirectory.end()) {
+          inotify_rm_watch(fd, found->second);
+          directoryByWatch.erase(found->second);
+          watchByDirectory.erase(found);
+        }
+        return true;
+      });
+    }
+
+    void discard(ComponentPtr node) {
+      if (node) { unwatchSubtree(*node); }
+    }
+
+    // dir 안에 name이 새로 생겼거나 바뀌었을 때
+    // 이미 있는 파일을 다시 읽을 때의 하드 링크 판정. 0 bytes인 노드는 중복으로 0을 받은 링크로 봄
+    static LinkAccounting accountingOf(const FilesystemComponent *existing) {
+      if (!existing || existing->isDirectory()) { return LinkAccounting::New; }
+      return existing->getSize() != 0 ? LinkAccounting::Counted : LinkAccounting::Duplicate;
+    }
+
+    // 크기와 종류는 스캔과 같은 backend.readEntry()로 얻으므로 심볼릭 링크 정책, 하드 링크 중복, --disk-usage를 그대로 따름
+    void entryAppeared(Directory &dir, std::string_view entryName) {
+      FilesystemComponent *existing = dir.findChild(entryName);
+      ScanEntry entry;
+      if (!backend.readEntry(pathOf(&dir), entryName, accountingOf(existing), entry)) { return; }
+
+      if (existing && existing->isDirectory() == entry.isDirectory) {
+        if (!entry.isDirectory) { static_cast<File *>(existing)->setSize(entry.size); }
+        return;
+      }
+      if (existing) { discard(dir.remove(existing)); }
+
+      if (!entry.isDirectory) {
+        dir.add(dir.createFile(entryName, entry.size));
+        return;
+      }
+      DirectoryPtr subDir = dir.createDirectory(entryName);
+      Directory &added = *subDir;
+      dir.add(std::move(subDir));
+      scanWatched(added);
+    }
+
+    void entryModified(Directory &dir, std::string_view entryName) {
+      FilesystemComponent *existing = dir.findChild(entryName);
+      if (!existing || existing->isDirectory()) { return; }
+      ScanEntry entry;
+      if (backend.readEntry(pathOf(&dir), entryName, accountingOf(existing), entry) && !entry.isDirectory) {
+        static_cast<File *>(existing)->setSize(entry.size);
+      }
+    }
+
+    // 이벤트 큐가 넘쳐서 일부를 잃었으면 전체를 다시 읽음
+    void rebuild() {
+      for (auto &entry: directoryByWatch) { inotify_rm_watch(fd, entry.first); }
+      directoryByWatch.clear();
+      watchByDirectory.clear();
+      pendingMoves.clear();
+      root.takeChildren();
+      // 하드 링크도 처음부터 다시 셈
+      backend.resetAccounting();
+      scanWatched(root);
+    }
+
+    void apply(const struct inotify_event &event) {
+      if (event.mask & IN_Q_OVERFLOW) {
+        rebuild();
+        return;
+      }
+      auto found = directoryByWatch.find(event.wd);
+      if (found == directoryByWatch.end()) { return; }
+      Directory &dir = *found->second;
+      if (event.mask & (IN_IGNORED | IN_DELETE_SELF)) {
+        directoryByWatch.erase(found);
+        watchByDirectory.erase(&dir);
+        return;
+      }
+      if (event.len == 0) { return; }
+      std::string_view entryName(event.name);
+
+      if (event.mask & IN_MOVED_FROM) {
+        FilesystemComponent *existing = dir.findChild(entryName);
+        if (existing) { pendingMoves[event.cookie] = dir.remove(existing); }
+      } else if (event.mask & IN_DELETE) {
+        FilesystemComponent *existing = dir.findChild(entryName);
+        if (existing) { discard(dir.remove(existing)); }
+      } else if (event.mask & IN_MOVED_TO) {
+        auto moved = pendingMoves.find(event.cookie);
+        if (moved == pendingMoves.end()) {
+          entryAppeared(dir, entryName);
+          return;
+        }
+        ComponentPtr node = std::move(moved->second);
+        pendingMoves.erase(moved);
+        FilesystemComponent *replaced = dir.findChild(entryName);
+        if (replaced) { discard(dir.remove(replaced)); }
+        // 새 이름이나 새 자리가 backend의 규칙(필터, 샤드 자리)에 걸리면 트리에서 뺌
+        ScanEntry entry;
+        if (!backend.readEntry(pathOf(&dir), entryName, accountingOf(node.get()), entry)) {
+          discard(std::move(node));
+          return;
+        }
+        if (entry.isDirectory != node->isDirectory()) {
+          // 옮긴 뒤 그 이름이 벌써 다른 종류로 바뀌었으면 새로 읽음
+          discard(std::move(node));
+          entryAppeared(dir, entryName);
+          return;
+        }
+        node->setName(entryName);
+        dir.add(std::move(node));
+      } else if (event.mask & IN_CREATE) {
+        entryAppeared(dir, entryName);
+      } else if (event.mask & (IN_MODIFY | IN_CLOSE_WRITE)) {
+        entryModified(dir, entryName);
+      }
+    }
+
+  public:
+    long long appliedEvents = 0;
+
+    // root는 이미 rootPath를 스캔한 결과여야 함
+    TreeWatcher(Directory &r, const fs::path &path, ScanBackend &b): root(r), rootPath(path), backend(b) {
+      fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+      if (fd < 0) { throw std::system_error(errno, std::generic_category(), "inotify_init1"); }
+      try {
+        watchSubtree(root);
+      } catch (...) {
+        close(fd);
+        throw;
+      }
+    }
+    TreeWatcher(const TreeWatcher &) = delete;
+    TreeWatcher &operator=(const TreeWatcher &) = delete;
+    ~TreeWatcher() { close(fd); }
+
+    size_t getWatchCount() const { return directoryByWatch.size(); }
+
+    // 최대 timeoutMs(음수면 무한) 동안 기다렸다가 도착한 이벤트를 모두 트리에 반영. 반영한 이벤트 수 반환
+    int poll(int timeoutMs) {
+      struct pollfd pfd = {fd, POLLIN, 0};
+      int ready = ::poll(&pfd, 1, timeoutMs);
+      if (ready < 0 && errno != EINTR) { throw std::system_error(errno, std::generic_category(), "poll"); }
+      if (ready <= 0) { return 0; }
+
+      alignas(struct inotify_event) char buffer[64 * 1024];
+      int applied = 0;
+      while (true) {
+        ssize_t bytes = read(fd, buffer, sizeof(buffer));
+        if (bytes < 0) {
+          if (errno == EINTR) { continue; }
+          if (errno == EAGAIN) { break; }
+          throw std::system_error(errno, std::generic_category(), "read inotify");
+        }
+        for (ssize_t offset = 0; offset < bytes;) {
+          auto *event = reinterpret_cast<struct inotify_event *>(buffer + offset);
+          apply(*event);
+          ++applied;
+          offset += static_cast<ssize_t>(sizeof(struct inotify_event) + event->len);
+        }
+      }
+      // 짝이 없는 IN_MOVED_FROM은 트리 밖으로 나간 것
+      for (auto &entry: pendingMoves) { discard(std::move(entry.second)); }
+      pendingMoves.clear();
+      appliedEvents += applied;
+      return applied;
+    }
+};
+#endif
+
+// 트리를 만들지 않고 rootPath를 DFS로 읽으면서 builder에 전위 순서로 알림 (SnapshotParser::parse와 같은 인터페이스)
+// 디렉터리는 항목을 다 읽은 뒤에 beginDirectory(name, 자식 수)를 부르므로, 메모리는 깊이 × 디렉터리 항목 수까지만 씀
+// 항목 순서는 buildFileststemTree()와 같음
+template <typename Builder>
+void scanTree(const fs::path &rootPath, std::string_view rootName, ScanBackend &backend, Builder &builder) {
+  struct Frame {
+    fs::path path;
+    std::vector<ScanEntry> entries;
+    size_t next;
+    DirectoryIdentity identity;
+  };
+  std::vector<Frame> stack;
+  stack.push_back({rootPath, {}, 0, backend.rootIdentity(rootPath)});
+  auto ancestors = [&stack](auto &&visit) {
+    for (auto frame = stack.rbegin(); frame != stack.rend() && !visit(frame->identity); ++frame) {}
+  };
+  {
+    FS_DIRECTORY_SCOPE(rootPath, 0, stack.back().entries);
+    backend.readDirectory(rootPath, stack.back().entries);
+  }
+  builder.beginDirectory(rootName, static_cast<long long>(stack.back().entries.size()));
+  while (!stack.empty()) {
+    Frame &top = stack.back();
+    if (top.next == top.entries.size()) {
+      stack.pop_back();
+      builder.endDirectory();
+      continue;
+    }
+    ScanEntry &entry = top.entries[top.next++];
+    if (!entry.isDirectory) {
+      builder.addFile(entry.name, entry.size);
+      continue;
+    }
+    DirectoryIdentity identity = ScanBackend::childIdentity(top.identity, entry);
+    if (backend.isCycle(identity, ancestors)) {
+      // 자식 수는 이미 알렸으므로 빈 디렉터리로 남김
+      builder.beginDirectory(entry.name, 0);
+      builder.endDirectory();
+      continue;
+    }
+    fs::path subPath = top.path / entry.name;
+    std::string dirName = std::move(entry.name);
+    stack.push_back({std::move(subPath), {}, 0, identity});
+    {
+      FS_DIRECTORY_SCOPE(stack.back().path, static_cast<int>(stack.size() - 1), stack.back().entries);
+      backend.readDirectory(stack.back().path, stack.back().entries);
+    }
+    builder.beginDirectory(dirName, static_cast<long long>(stack.back().entries.size()));
+  }
+}
+
+// builder 이벤트를 serialize() 텍스트로 바로 흘려 쓰는 builder (스트리밍 스냅샷용)
+// 텍스트 형식에는 디렉터리 합계가 없고 자식 수만 있으므로 되돌아가 고칠 것이 없음
+// 합계는 열린 디렉터리마다 하나씩만 들고 있다가, 디렉터리가 닫힐 때 onDirectoryTotal(depth, name, size)로 알림
+class SnapshotStreamWriter {
+  private:
+    struct Open {
+      std::string name;
+      long long size;
+    };
+    OutputSink &sink;
+    std::vector<Open> open;
+    std::function<void(int, std::string_view, long long)> onDirectoryTotal;
+
+  public:
+    long long totalSize = 0;
+    long long fileCount = 0;
+    long long dirCount = 0;  // 루트 제외
+
+    explicit SnapshotStreamWriter(OutputSink &s, std::function<void(int, std::string_view, long long)> onTotal = nullptr)
+        : sink(s), onDirectoryTotal(std::move(onTotal)) {}
+
+    void beginDirectory(std::string_view dirName, long long childCount) {
+      if (!open.empty()) { ++dirCount; }
+      open.push_back({std::string(dirName), 0});
+      sink.write("D|");
+      sink.write(dirName);
+      sink.put('|');
+      sink.writeNumber(childCount);
+      sink.put('[');
+    }
+    void addFile(std::string_view fileName, long long fileSize) {
+      ++fileCount;
+      open.back().size += fileSize;
+      sink.write("F|");
+      sink.write(fileName);
+      sink.put('|');
+      sink.writeNumber(fileSize);
+    }
+    void endDirectory() {
+      Open done = std::move(open.back());
+      open.pop_back();
+      sink.put(']');
+      if (onDirectoryTotal) { onDirectoryTotal(static_cast<int>(open.size()), done.name, done.size); }
+      if (open.empty()) {
+        totalSize = done.size;
+      } else {
+        open.back().size += done.size;
+      }
+    }
+};
+
+// 구조 배열(SoA) 형태의 평탄한 트리 엔진 (FilesystemComponent 트리와 별개로 쓸 수 있음)
+// 노드는 전위 순서로 배열에 놓이므로 하위 트리는 [i, getSubtreeEnd(i)) 구간 하나이고,
+// 합계 같은 집계는 가상 호출이나 포인터 추적 없이 연속된 배열을 한 번 훑어서 끝남
+// 출력(display/serialize)은 같은 내용의 Directory와 바이트 단위로 같음
+class FlatTree {
+  public:
+    static constexpr uint32_t noParent = UINT32_MAX;
+
+  private:
+    // 입력에 적힌 자식 수는 믿을 수 없으므로 미리 잡는 자리는 이만큼까지만 (ComponentTreeBuilder와 같음)
+    static constexpr long long maxReservedNodes = 1 << 16;
+
+    std::vector<uint32_t> parents;
+    std::vector<uint32_t> subtreeEnds;
+    std::vector<uint32_t> childCounts;
+    std::vector<long long> sizes;  // 파일은 크기, 디렉터리는 하위 트리 합계
+    std::vector<uint64_t> nameOffsets;
+    std::vector<uint32_t> nameLengths;
+    std::vector<uint8_t> directoryFlags;
+    std::string names;
+    std::vector<uint32_t> openDirectories;  // 만드는 중에 열려 있는 디렉터리
+
+    uint32_t appendNode(std::string_view nodeName, long long nodeSize, bool isDir) {
+      if (parents.size() >= noParent) { throw std::length_error("FlatTree: too many nodes"); }
+      uint32_t index = static_cast<uint32_t>(parents.size());
+      uint32_t parent = openDirectories.empty() ? noParent : openDirectories.back();
+      parents.push_back(parent);
+      subtreeEnds.push_back(index + 1);
+      childCounts.push_back(0);
+      sizes.push_back(nodeSize);
+      nameOffsets.push_back(names.size());
+      nameLengths.push_back(static_cast<uint32_t>(nodeName.size()));
+      directoryFlags.push_back(isDir ? 1 : 0);
+      names.append(nodeName.data(), nodeName.size());
+      if (parent != noParent) { ++childCounts[parent]; }
+      return index;
+    }
+
+  public:
+    // 빌더 인터페이스 (SnapshotParser::parse, 스캐너가 전위 순서로 호출)
+    void beginDirectory(std::string_view dirName, long long childCountHint = 0) {
+      if (parents.empty() && childCountHint > 0) {
+        reserve(static_cast<size_t>(std::min(childCountHint, maxReservedNodes)) + 1);
+      }
+      openDirectories.push_back(appendNode(dirName, 0, true));
+    }
+    void addFile(std::string_view fileName, long long fileSize) {
+      appendNode(fileName, fileSize, false);
+      sizes[openDirectories.back()] += fileSize;
+    }
+    void endDirectory() {
+      uint32_t dir = openDirectories.back();
+      openDirectories.pop_back();
+      subtreeEnds[dir] = static_cast<uint32_t>(parents.size());
+      if (!openDirectories.empty()) { sizes[openDirectories.back()] += sizes[dir]; }
+    }
+    // 파일/디렉터리 수를 노드 수로 세므로 접힌 디렉터리의 합계를 담을 수 없음
+    void addCollapsedDirectory(std::string_view, long long, long long, long long) {
+      throw std::runtime_error("FlatTree: snapshot has directories collapsed by --max-depth");
+    }
+
+    void reserve(size_t nodes) {
+      parents.reserve(nodes);
+      subtreeEnds.reserve(nodes);
+      childCounts.reserve(nodes);
+      sizes.reserve(nodes);
+      nameOffsets.reserve(nodes);
+      nameLengths.reserve(nodes);
+      directoryFlags.reserve(nodes);
+    }
+
+    // serialize() 텍스트에서 만들기
+    static FlatTree fromText(std::string_view data) {
+      FlatTree tree;
+      SnapshotParser(data).parse(tree);
+      return tree;
+    }
+
+    // 바이너리 스냅샷에서 만들기 (디렉터리 합계는 파일 크기로부터 다시 계산됨)
+    static FlatTree fromSnapshot(const SnapshotView &view) {
+      FlatTree tree;
+      view.forEach([&tree](const SnapshotView::Node &node, int depth) {
+        while (tree.openDirectories.size() > static_cast<size_t>(depth)) { tree.endDirectory(); }
+        if (node.isDirectory) {
+          tree.beginDirectory(node.name, static_cast<long long>(node.childCount));
+        } else {
+          tree.addFile(node.name, node.size);
+        }
+      });
+      while (!tree.openDirectories.empty()) { tree.endDirectory(); }
+      return tree;
+    }
+
+    // 기존 노드 트리에서 만들기
+    static FlatTree fromComponent(const FilesystemComponent &root) {
+      FlatTree tree;
+      traverseTree(root,
+                   [&tree](const FilesystemComponent &node, int) {
+                     if (node.isDirectory()) {
+                       tree.beginDirectory(node.getNameView());
+                     } else {
+                       tree.addFile(node.getNameView(), node.getSize());
+                     }
+                     return true;
+                   },
+                   [&tree](const Directory &, int) { tree.endDirectory(); });
+      return tree;
+    }
+
+    // 디렉터리를 바로 스캔해서 만들기 (항목 순서는 buildFileststemTree()와 같음)
+    static FlatTree fromScan(const fs::path &rootPath, std::string_view rootName, ScanBackend &backend) {
+      FlatTree tree;
+      scanTree(rootPath, rootName, backend, tree);
+      return tree;
+    }
+
+    size_t size() const { return parents.size(); }
+    uint32_t getParent(uint32_t i) const { return parents[i]; }
+    uint32_t getSubtreeEnd(uint32_t i) const { return subtreeEnds[i]; }
+    uint32_t getChildCount(uint32_t i) const { return childCounts[i]; }
+    long long getSize(uint32_t i) const { return sizes[i]; }
+    bool isDirectory(uint32_t i) const { return directoryFlags[i] != 0; }
+    std::string_view getName(uint32_t i) const {
+      return std::string_view(names.data() + nameOffsets[i], nameLengths[i]);
+    }
+
+    // 전체 합계 (루트 디렉터리의 합계)
+    long long getSize() const { return sizes.empty() ? 0 : sizes[0]; }
+
+    // 디렉터리 합계를 파일 크기로부터 다시 계산 (뒤에서 앞으로 한 번 훑음)
+    void recomputeTotals() {
+      for (size_t i = 0; i < sizes.size(); ++i) {
+        if (directoryFlags[i]) { sizes[i] = 0; }
+      }
+      for (size_t i = sizes.size(); i-- > 1;) { sizes[parents[i]] += sizes[i]; }
+    }
+
+    // [i, getSubtreeEnd(i)) 안의 파일 수
+    long long countFiles(uint32_t i) const {
+      long long count = 0;
+      for (uint32_t j = i, end = subtreeEnds[i]; j < end; ++j) { count += directoryFlags[j] ? 0 : 1; }
+      return count;
+    }
+
+    // Directory::display()와 같은 형식으로 출력
+    void display(OutputSink &sink) const {
+      std::vector<uint32_t> ends;  // 열려 있는 디렉터리들의 subtreeEnd (깊이 계산용)
+      for (uint32_t i = 0; i < parents.size(); ++i) {
+        while (!ends.empty() && ends.back() <= i) { ends.pop_back(); }
+        writeDisplayLine(sink, static_cast<int>(ends.size()), getName(i), sizes[i], isDirectory(i));
+        if (isDirectory(i)) { ends.push_back(subtreeEnds[i]); }
+      }
+    }
+
+    // Directory::serialize()와 같은 텍스트로 출력
+    void serialize(OutputSink &sink) const {
+      std::vector<uint32_t> ends;
+      for (uint32_t i = 0; i < parents.size(); ++i) {
+        while (!ends.empty() && ends.back() <= i) {
+          ends.pop_back();
+          sink.put(']');
+        }
+        sink.write(isDirectory(i) ? "D|" : "F|");
+        sink.write(getName(i));
+        sink.put('|');
+        if (isDirectory(i)) {
+          sink.writeNumber(childCounts[i]);
+          sink.put('[');
+          ends.push_back(subtreeEnds[i]);
+        } else {
+          sink.writeNumber(sizes[i]);
+        }
+      }
+      for (size_t k = 0; k < ends.size(); ++k) { sink.put(']'); }
+    }
+
+    // 노드 트리로 바꾸기 (root는 비어 있어야 함)
+    void materialize(Directory &root) const {
+      ComponentTreeBuilder builder(root);
+      std::vector<uint32_t> ends;
+      for (uint32_t i = 0; i < parents.size(); ++i) {
+        while (!ends.empty() && ends.back() <= i) {
+          ends.pop_back();
+          builder.endDirectory();
+        }
+        if (isDirectory(i)) {
+          builder.beginDirectory(getName(i), childCounts[i]);
+          ends.push_back(subtreeEnds[i]);
+        } else {
+          builder.addFile(getName(i), sizes[i]);
+        }
+      }
+      for (size_t k = 0; k < ends.size(); ++k) { builder.endDirectory(); }
+    }
+};
+
+// 스냅샷을 지연 펼침 트리로 여는 것. Directory 노드는 펼치는 디렉터리의 자식만 만듦
+// 버전 3 이상의 바이너리 스냅샷은 mmap한 파일을 그대로 두고, 디렉터리를 펼칠 때 그 레코드의 바로 아래 자식만 읽음
+// (하위 디렉터리는 subtreeBytes만큼 건너뛰고 합계는 레코드에 있으므로 미리 읽는 것이 없음. 추가 메모리는 만든 노드뿐)
+// 건너뛸 길이가 없는 텍스트, 압축, 버전 1/2 바이너리 스냅샷은 처음에 FlatTree로 한 번 다 읽고(노드 객체 없이 배열만) 거기서 만듦
+// 어느 쪽이든 합계를 미리 알고 있으므로 펼치지 않은 디렉터리도 getSize() 등은 O(1)
+// 바이너리의 레코드가 범위를 벗어나거나 자식의 합계가 디렉터리 레코드와 다르면 그 디렉터리를 펼칠 때 DeserializeError
+class LazySnapshotTree : public LazyChildSource {
+  private:
+    std::unique_ptr<SnapshotView> view;  // 바이너리 스냅샷에서 바로 읽을 때만 있음
+    FlatTree flat;
+    std::vector<long long> fileCounts;  // flat의 노드마다 하위 트리의 파일 수 / 디렉터리 수 (자기 제외)
+    std::vector<long long> dirCounts;
+    Directory root;
+
+    static SnapshotView::Node readRoot(const SnapshotView &snapshot) {
+      if (snapshot.getVersion() < 3) { throw std::invalid_argument("LazySnapshotTree: binary snapshot has no subtree lengths"); }
+      size_t pos = snapshot.getTableStart();
+      SnapshotView::Node node = snapshot.readNode(pos);
+      if (!node.isDirectory) { throw DeserializeError("root is not a directory", snapshot.getTableStart()); }
+      if (node.subtreeBytes != snapshot.getTableEnd() - pos) { throw DeserializeError("root subtree does not match node table", pos); }
+      return node;
+    }
+
+    // token은 디렉터리 레코드의 위치
+    std::vector<ComponentPtr> loadFromView(Directory &dir, size_t recordStart) {
+      size_t pos = recordStart;
+      SnapshotView::Node parent = view->readNode(pos);
+      if (!parent.isDirectory) { throw DeserializeError("expected a directory record", recordStart); }
+      size_t end = pos + parent.subtreeBytes;  // 부모를 펼칠 때 테이블 안인지 확인했음
+      std::vector<ComponentPtr> children;
+      // 적힌 자식 수는 믿을 수 없으므로 레코드가 들어갈 수 있는 만큼까지만 (레코드는 최소 4바이트)
+      children.reserve(static_cast<size_t>(std::min<uint64_t>(parent.childCount, (end - pos) / 4)));
+      // 손상된 입력의 합이 넘치지 않도록 부호 없는 정수로 셈
+      uint64_t size = 0;
+      uint64_t files = 0;
+      uint64_t dirs = 0;
+      for (uint64_t i = 0; i < parent.childCount; ++i) {
+        size_t childStart = pos;
+        if (pos >= end) { throw DeserializeError("directory has fewer records than children", pos); }
+        SnapshotView::Node node = view->readNode(pos);
+        if (pos > end || (node.isDirectory && node.subtreeBytes > end - pos)) {
+          throw DeserializeError("record overruns its directory", childStart);
+        }
+        size += static_cast<uint64_t>(node.size);
+        if (node.isDirectory) {
+          DirectoryPtr subDir = dir.createDirectory(node.name);
+          subDir->setLazy(this, childStart, node.size, node.fileCount, node.dirCount);
+          children.push_back(std::move(subDir));
+          files += static_cast<uint64_t>(node.fileCount);
+          dirs += static_cast<uint64_t>(node.dirCount) + 1;
+          pos += node.subtreeBytes;
+        } else {
+          children.push_back(dir.createFile(node.name, node.size));
+          ++files;
+        }
+      }
+      if (pos != end) { throw DeserializeError("directory has more records than children", pos); }
+      if (size != static_cast<uint64_t>(parent.size) || files != static_cast<uint64_t>(parent.fileCount) ||
+          dirs != static_cast<uint64_t>(parent.dirCount)) {
+        throw DeserializeError("directory totals do not match its children", recordStart);
+      }
+      return children;
+    }
+
+    std::vector<ComponentPtr> loadFromFlat(Directory &dir, uint32_t index) {
+      std::vector<ComponentPtr> children;
+      children.reserve(flat.getChildCount(index));
+      for (uint32_t i = index + 1, end = flat.getSubtreeEnd(index); i < end;) {
+        if (flat.isDirectory(i)) {
+          DirectoryPtr subDir = dir.createDirectory(flat.getName(i));
+          subDir->setLazy(this, i, flat.getSize(i), fileCounts[i], dirCounts[i]);
+          children.push_back(std::move(subDir));
+          i = flat.getSubtreeEnd(i);
+        } else {
+          children.push_back(dir.createFile(flat.getName(i), flat.getSize(i)));
+          ++i;
+        }
+      }
+      return children;
+    }
+
+  public:
+    long long loadedDirectories = 0;  // 지금까지 펼친 디렉터리 수
+
+    // 버전 3 이상의 바이너리 스냅샷 (루트 레코드만 읽음)
+    explicit LazySnapshotTree(std::unique_ptr<SnapshotView> snapshot)
+        : view(std::move(snapshot)), root(std::string(readRoot(*view).name)) {
+      SnapshotView::Node node = readRoot(*view);
+      root.setLazy(this, view->getTableStart(), node.size, node.fileCount, node.dirCount);
+    }
+
+    explicit LazySnapshotTree(FlatTree tree): flat(std::move(tree)), root(flat.size() ? std::string(flat.getName(0)) : "") {
+      fileCounts.assign(flat.size(), 0);
+      dirCounts.assign(flat.size(), 0);
+      for (size_t i = flat.size(); i-- > 1;) {
+        uint32_t parent = flat.getParent(static_cast<uint32_t>(i));
+        bool isDir = flat.isDirectory(static_cast<uint32_t>(i));
+        fileCounts[parent] += fileCounts[i] + (isDir ? 0 : 1);
+        dirCounts[parent] += dirCounts[i] + (isDir ? 1 : 0);
+      }
+      if (flat.size()) { root.setLazy(this, 0, flat.getSize(0), fileCounts[0], dirCounts[0]); }
+    }
+    LazySnapshotTree(const LazySnapshotTree &) = delete;
+    LazySnapshotTree &operator=(const LazySnapshotTree &) = delete;
+
+    // 텍스트(serialize()), 바이너리, 압축 스냅샷 파일에서 (앞 4바이트로 구분, 압축 형식 정의 뒤에서 구현)
+    static std::unique_ptr<LazySnapshotTree> open(const std::string &path);
+
+    Directory &getRoot() { return root; }
+    // 스냅샷 파일을 펼칠 때마다 읽는 방식인지 (false면 처음에 전부 읽어 둔 것)
+    bool readsOnDemand() const { return view != nullptr; }
+
+    std::vector<ComponentPtr> loadChildren(Directory &dir, uint64_t token) override {
+      ++loadedDirectories;
+      if (view) { return loadFromView(dir, static_cast<size_t>(token)); }
+      return loadFromFlat(dir, static_cast<uint32_t>(token));
+    }
+};
+
+// 디렉터리 하나의 항목을 읽어서 이름순으로 정렬해 반환 (병렬 스캐너용)
+std::vector<ScanEntry> readDirectoryEntries(const fs::path &path, ScanBackend &backend) {
+  std::vector<ScanEntry> entries;
+  backend.readDirectory(path, entries);
+  std::sort(entries.begin(), entries.end(),
+            [](const ScanEntry &a, const ScanEntry &b) { return a.name < b.name; });
+  return entries;
+}
+
+// 작업 훔치기(work stealing) 스레드 풀
+// 각 워커는 자기 deque 뒤쪽에서 작업을 꺼내고, 비면 다른 워커 deque 앞쪽에서 훔쳐 온다
+class WorkStealingPool {
+  private:
+    struct Worker {
+      std::mutex lock;
+      std::deque<std::function<void()>> tasks;
+    };
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<long long> queued{0};   // deque에 들어있는 작업 수
+    std::atomic<long long> pending{0};  // 아직 끝나지 않은 작업 수 (실행 중 포함)
+    std::mutex idleLock;
+    std::condition_variable idleCv;
+    std::mutex errorLock;
+    std::exception_ptr firstError;
+    inline static thread_local int currentWorker = -1;
+
+    bool tryPop(int self, std::function<void()> &task) {
+      {
+        Worker &own = *workers[self];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (!own.tasks.empty()) {
+          task = std::move(own.tasks.back());
+          own.tasks.pop_back();
+          --queued;
+          return true;
+        }
+      }
+      int count = static_cast<int>(workers.size());
+      for (int i = 1; i < count; ++i) {
+        Worker &victim = *workers[(self + i) % count];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.tasks.empty()) {
+          task = std::move(victim.tasks.front());
+          victim.tasks.pop_front();
+          --queued;
+          return true;
+        }
+      }
+      return false;
+    }
+
+    void workerLoop(int self) {
+      currentWorker = self;
+      std::function<void()> task;
+      while (true) {
+        if (tryPop(self, task)) {
+          try {
+            task();
+          } catch (...) {
+            std::lock_guard<std::mutex> guard(errorLock);
+            if (!firstError) { firstError = std::current_exception(); }
+          }
+          task = nullptr;
+          if (--pending == 0) {
+            std::lock_guard<std::mutex> guard(idleLock);
+            idleCv.notify_all();
+          }
+          continue;
+        }
+        std::unique_lock<std::mutex> lk(idleLock);
+        idleCv.wait(lk, [this] { return queued > 0 || pending == 0; });
+        if (pending == 0) { break; }
+      }
+      currentWorker = -1;
+    }
+
+  public:
+    explicit WorkStealingPool(unsigned threadCount) {
+      if (threadCount == 0) { threadCount = 1; }
+      for (unsigned i = 0; i < threadCount; ++i) { workers.push_back(std::make_unique<Worker>()); }
+    }
+
+    // 작업 추가. 워커 안에서 호출하면 그 워커의 deque에, 밖에서 호출하면 0번 워커에 들어감
+    void submit(std::function<void()> task) {
+      int target = currentWorker >= 0 ? currentWorker : 0;
+      ++pending;
+      {
+        std::lock_guard<std::mutex> guard(workers[target]->lock);
+        workers[target]->tasks.push_back(std::move(task));
+      }
+      ++queued;
+      std::lock_guard<std::mutex> guard(idleLock);
+      idleCv.notify_one();
+    }
+
+    // 모든 작업(작업 중에 추가된 것 포함)이 끝날 때까지 실행. 작업에서 난 첫 예외를 다시 던짐
+    void run() {
+      std::vector<std::thread> threads;
+      for (size_t i = 0; i < workers.size(); ++i) {
+        threads.emplace_back(&WorkStealingPool::workerLoop, this, static_cast<int>(i));
+      }
+      for (std::thread &t: threads) { t.join(); }
+      if (firstError) { std::rethrow_exception(firstError); }
+    }
+};
+
+// 하위 디렉터리 하나를 하나의 작업으로 처리하는 병렬 스캐너
+// 디렉터리는 자기 하위 디렉터리 작업이 모두 끝난 뒤에 자식을 붙이므로, 트리는 스레드 간 공유 없이 아래에서 위로 완성된다
+class ParallelScanner {
+  private:
+    struct Job {
+      fs::path path;
+      Directory *dir;
+      Job *parentJob;
+      int depth = 0;
+      DirectoryIdentity identity;
+      bool collapse = false;  // 깊이 제한: 하위를 읽어 합계만 둠
+      std::vector<ComponentPtr> entries;
+      std::vector<std::unique_ptr<Job>> subJobs;
+      std::atomic<int> remaining{1};  // 자기 자신의 읽기 + 하위 디렉터리 수
+    };
+    WorkStealingPool pool;
+    ScanBackend &backend;
+
+    void scan(Job *job) {
+      if (job->collapse) {
+        try {
+          auto outer = [job](auto &&visit) {
+            for (Job *ancestor = job->parentJob; ancestor && !visit(ancestor->identity); ancestor = ancestor->parentJob) {}
+          };
+          SubtreeTotals totals = countSubtree(job->path, job->identity, backend, outer);
+          job->dir->setCollapsed(totals.size, totals.files, totals.dirs);
+        } catch (...) {
+          finish(job);
+          throw;
+        }
+        finish(job);
+        return;
+      }
+      try {
+        std::vector<ScanEntry> scanned;
+        {
+          FS_DIRECTORY_SCOPE(job->path, job->depth, scanned);
+          scanned = readDirectoryEntries(job->path, backend);
+        }
+        int subDirs = 0;
+        job->entries.reserve(scanned.size());
+        auto ancestors = [job](auto &&visit) {
+          for (Job *ancestor = job; ancestor && !visit(ancestor->identity); ancestor = ancestor->parentJob) {}
+        };
+        for (ScanEntry &entry: scanned) {
+          if (entry.isDirectory) {
+            DirectoryIdentity identity = ScanBackend::childIdentity(job->identity, entry);
+            if (backend.isCycle(identity, ancestors)) {
+              job->entries.push_back(job->dir->createDirectory(std::move(entry.name)));
+              continue;
+            }
+            auto subJob = std::make_unique<Job>();
+            subJob->identity = identity;
+            subJob->path = job->path / entry.name;
+            DirectoryPtr subDir = job->dir->createDirectory(std::move(entry.name));
+            subJob->dir = subDir.get();
+            job->entries.push_back(std::move(subDir));
+            subJob->parentJob = job;
+            subJob->depth = job->depth + 1;
+            subJob->collapse = backend.policy.maxDepth >= 0 && subJob->depth >= backend.policy.maxDepth;
+            job->subJobs.push_back(std::move(subJob));
+            ++subDirs;
+          } else {
+            job->entries.push_back(job->dir->createFile(std::move(entry.name), entry.size));
+          }
+        }
+        job->remaining += subDirs;
+        for (std::unique_ptr<Job> &subJob: job->subJobs) {
+          Job *next = subJob.get();
+          pool.submit([this, next] { scan(next); });
+        }
+      } catch (...) {
+        finish(job);
+        throw;
+      }
+      finish(job);
+    }
+
+    // 남은 일이 없는 디렉터리에 자식들을 붙이고, 부모 쪽으로 완료를 알림
+    void finish(Job *job) {
+      while (job && --job->remaining == 0) {
+        job->dir->reserve(job->dir->getChildren().size() + job->entries.size());
+        for (ComponentPtr &entry: job->entries) { job->dir->add(std::move(entry)); }
+        job->entries.clear();
+        job->subJobs.clear();
+        job = job->parentJob;
+      }
+    }
+
+  public:
+    ParallelScanner(unsigned threadCount, ScanBackend &b): pool(threadCount), backend(b) {}
+
+    void scan(const fs::path &rootPath, Directory *root) {
+      FS_PHASE_SCOPE(InstrumentPhase::Scan);
+      Job rootJob;
+      rootJob.path = rootPath;
+      rootJob.dir = root;
+      rootJob.parentJob = nullptr;
+      rootJob.identity = backend.rootIdentity(rootPath);
+      rootJob.collapse = backend.policy.maxDepth == 0;
+      pool.submit([this, &rootJob] { scan(&rootJob); });
+      pool.run();
+    }
+};
+
+// 병렬 버전. 각 디렉터리의 항목은 이름순으로 정렬되어 실행할 때마다 같은 순서로 출력됨
+void buildFileststemTreeParallel(const fs::path &currentPath, Directory *parentDir, unsigned threadCount,
+                                 ScanBackend &backend) {
+  if (!parentDir) return;
+  ParallelScanner scanner(threadCount, backend);
+  scanner.scan(currentPath, parentDir);
+}
+
+// 나눠서 스캔하기 (샤드)
+// 샤드는 루트 "." 아래에 스캔한 경로(예: "src/lib")까지의 중간 디렉터리와 그 하위 트리만 든 보통 스냅샷이고,
+// 기준 스캔은 --shard-at으로 정한 디렉터리를 빈 디렉터리로 남겨 둠. 여러 마운트 지점을 한 트리로 스캔할 때도 같은 방법을 씀
+
+// 스캔 경로 비교용 키 ("./a/b/" -> "a/b")
+std::string scanPathKey(const fs::path &path) {
+  std::string key = path.lexically_normal().string();
+  while (key.size() > 1 && key.back() == '/') { key.pop_back(); }
+  return key;
+}
+
+// 정해 둔 디렉터리는 읽지 않고 빈 디렉터리로 남기는 backend (다른 샤드가 채울 자리)
+// 스캐너는 backend만 거치므로 직렬/병렬/스트리밍 스캔 모두에 그대로 적용됨. 통계는 inner와 같이 씀
+class ShardCutBackend : public ScanBackend {
+  private:
+    ScanBackend &inner;
+    std::unordered_set<std::string> cuts;
+
+  public:
+    ShardCutBackend(ScanBackend &b, const std::vector<std::string> &cutPaths): ScanBackend(b), inner(b) {
+      for (const std::string &path: cutPaths) { cuts.insert(scanPathKey(path)); }
+    }
+
+    void readDirectory(const fs::path &path, std::vector<ScanEntry> &entries) override {
+      if (cuts.count(scanPathKey(path))) { return; }
+      inner.readDirectory(path, entries);
+    }
+    // 남겨 둔 자리 안에 생긴 항목도 다른 샤드의 몫이므로 읽지 않음
+    bool readEntry(const fs::path &path, std::string_view name, LinkAccounting accounting, ScanEntry &entry) override {
+      if (cuts.count(scanPathKey(path))) { return false; }
+      return inner.readEntry(path, name, accounting, entry);
+    }
+};
+
+// root 기준 경로의 디렉터리 (없는 중간 디렉터리는 root와 같은 방식으로 만들어 붙임)
+Directory *ensureDirectoryPath(Directory &root, std::string_view path) {
+  Directory *dir = &root;
+  std::string normalized = normalizeTreePath(path);
+  std::string_view rest = normalized;
+  while (!rest.empty()) {
+    size_t end = std::min(rest.find('/'), rest.size());
+    std::string_view part = rest.substr(0, end);
+    rest.remove_prefix(std::min(end + 1, rest.size()));
+    if (part == "..") { throw std::invalid_argument("shard path must not contain '..'"); }
+    FilesystemComponent *child = dir->findChild(part);
+    if (child && !child->isDirectory()) { throw std::invalid_argument("shard path goes through a file"); }
+    if (!child) {
+      DirectoryPtr created = dir->createDirectory(part);
+      child = created.get();
+      dir->add(std::move(created));
+    }
+    dir = static_cast<Directory *>(child);
+  }
+  return dir;
+}
+
+// source의 자식들을 target으로 옮겨 합침 (source는 비게 됨)
+// 양쪽에 같은 이름의 디렉터리가 있을 때만 따라 내려가고, 한쪽에만 있는 하위 트리는 노드째로 옮기므로 다시 순회하지 않음
+// target의 빈 디렉터리(남겨 둔 자리)는 source의 디렉터리로 통째로 바꾸고, 이름이 같은 파일이나 종류가 다른 항목은 source 쪽을 씀
+// 합계는 add()/remove()가 옮긴 하위 트리 단위로 한 번씩 전파함. 두 트리는 같은 방식(힙 또는 같은 arena)으로 소유되어야 함
+void mergeTrees(Directory &target, Directory &source) {
+  std::vector<std::pair<Directory *, Directory *>> pending{{&target, &source}};
+  std::vector<ComponentPtr> emptied;  // 내용을 옮긴 source 쪽 디렉터리 (pending이 가리키므로 끝날 때까지 둠)
+  while (!pending.empty()) {
+    auto [into, from] = pending.back();
+    pending.pop_back();
+    std::vector<ComponentPtr> children = from->takeChildren();
+    into->reserve(into->getChildren().size() + children.size());
+    for (ComponentPtr &child: children) {
+      FilesystemComponent *existing = into->findChild(child->getNameView());
+      if (existing && existing->isDirectory() && child->isDirectory() &&
+          !static_cast<Directory *>(existing)->getChildren().empty()) {
+        pending.push_back({static_cast<Directory *>(existing), static_cast<Directory *>(child.get())});
+        emptied.push_back(std::move(child));
+        continue;
+      }
+      if (existing) { into->remove(existing); }
+      into->add(std::move(child));
+    }
+  }
+}
+
+// rootPath를 스캔해서 root 아래 같은 경로 자리에 합침 (여러 루트, 샤드 스캔)
+void scanShard(const std::string &rootPath, Directory &root, unsigned threadCount, ScanBackend &backend) {
+  std::string treePath = normalizeTreePath(rootPath);
+  ComponentPtr wrapper(root.createDirectory(root.getNameView()));
+  Directory *shardRoot = ensureDirectoryPath(static_cast<Directory &>(*wrapper), treePath);
+  if (threadCount > 0) {
+    buildFileststemTreeParallel(rootPath, shardRoot, threadCount, backend);
+  } else {
+    buildFileststemTree(rootPath, shardRoot, backend);
+  }
+  mergeTrees(root, static_cast<Directory &>(*wrapper));
+}
+
+// 병렬 집계/직렬화를 위해 트리를 전위 순서의 조각으로 나눈 것
+//   Open/Close: 한 작업이 맡기에 큰 디렉터리(하위 노드 수 > grain)를 펼친 시작과 끝
+//   Range: 디렉터리 자식 [begin, end)를 하나의 작업으로 묶은 것 (노드 수가 grain 정도가 되도록)
+template <typename Dir>
+struct TreePiece {
+  enum Kind { Open, Range, Close };
+  Kind kind;
+  Dir *dir;
+  size_t begin = 0;
+  size_t end = 0;
+};
+
+// 노드 수는 캐시된 fileCount/dirCount로 어림함 (나누는 기준일 뿐이라 틀려도 결과에는 영향 없음)
+inline long long subtreeWeight(const FilesystemComponent &node) {
+  // 접힌 디렉터리는 합계만 가진 노드 하나 (펼쳐서 나누면 직렬화에서 합계가 빠짐)
+  if (!node.isDirectory() || static_cast<const Directory &>(node).isCollapsed()) { return 1; }
+  return 1 + node.getFileCount() + node.getDirectoryCount();
+}
+
+// 스레드마다 여러 작업이 돌아가도록 나누되, 작업이 너무 잘게 쪼개지지 않게 함
+inline long long parallelGrain(const FilesystemComponent &root, unsigned threadCount) {
+  return std::max<long long>(4096, subtreeWeight(root) / (static_cast<long long>(threadCount) * 16));
+}
+
+template <typename Dir>
+std::vector<TreePiece<Dir>> partitionTree(Dir &root, long long grain) {
+  struct Frame {
+    Dir *dir;
+    size_t next;
+  };
+  std::vector<TreePiece<Dir>> pieces;
+  std::vector<Frame> stack;
+  pieces.push_back({TreePiece<Dir>::Open, &root});
+  stack.push_back({&root, 0});
+  while (!stack.empty()) {
+    Frame &top = stack.back();
+    auto &children = top.dir->getChildren();
+    if (top.next == children.size()) {
+      pieces.push_back({TreePiece<Dir>::Close, top.dir});
+      stack.pop_back();
+      continue;
+    }
+    // 작은 자식들을 grain까지 묶음
+    size_t begin = top.next;
+    long long weight = 0;
+    while (top.next < children.size()) {
+      long long childWeight = subtreeWeight(*children[top.next]);
+      if (childWeight > grain || (weight > 0 && weight + childWeight > grain)) { break; }
+      weight += childWeight;
+      ++top.next;
+    }
+    if (top.next > begin) {
+      pieces.push_back({TreePiece<Dir>::Range, top.dir, begin, top.next});
+      continue;
+    }
+    // grain보다 큰 자식은 디렉터리뿐이고, 펼쳐서 그 안을 다시 나눔
+    Dir *big = static_cast<Dir *>(children[top.next++]);
+    pieces.push_back({TreePiece<Dir>::Open, big});
+    stack.push_back({big, 0});
+  }
+  return pieces;
+}
+
+// Directory::serialize()와 같은 결과를 여러 스레드로 만듦
+// 조각마다 따로 직렬화한 뒤 원래 순서대로 이어 쓰므로, 출력 전에 결과 전체가 메모리에 모임
+void serializeTreeParallel(const Directory &root, OutputSink &sink, unsigned threadCount) {
+  long long grain = parallelGrain(root, threadCount);
+  if (threadCount <= 1 || subtreeWeight(root) <= grain) {
+    root.serialize(sink);
+    return;
+  }
+  std::vector<TreePiece<const Directory>> pieces = partitionTree(root, grain);
+  std::vector<std::string> chunks(pieces.size());
+  WorkStealingPool pool(threadCount);
+  for (size_t i = 0; i < pieces.size(); ++i) {
+    if (pieces[i].kind != TreePiece<const Directory>::Range) { continue; }
+    pool.submit([&pieces, &chunks, i] {
+      const TreePiece<const Directory> &piece = pieces[i];
+      StringSink out;
+      for (size_t k = piece.begin; k < piece.end; ++k) { piece.dir->getChildren()[k]->serialize(out); }
+      chunks[i] = out.take();
+    });
+  }
+  pool.run();
+  for (size_t i = 0; i < pieces.size(); ++i) {
+    const TreePiece<const Directory> &piece = pieces[i];
+    switch (piece.kind) {
+      case TreePiece<const Directory>::Open:
+        sink.write("D|");
+        sink.write(piece.dir->getNameView());
+        sink.put('|');
+        sink.writeNumber(static_cast<long long>(piece.dir->getChildren().size()));
+        sink.put('[');
+        break;
+      case TreePiece<const Directory>::Range: sink.write(chunks[i]); break;
+      case TreePiece<const Directory>::Close: sink.put(']'); break;
+    }
+  }
+}
+
+// Directory::recomputeTotals()의 병렬 버전
+// 묶음 안의 하위 트리는 작업마다 따로 계산하고, 펼친 디렉터리는 마지막에 후위 순서(Close 순서)로 채움
+void recomputeTotalsParallel(Directory &root, unsigned threadCount) {
+  long long grain = parallelGrain(root, threadCount);
+  if (threadCount <= 1 || subtreeWeight(root) <= grain) {
+    root.recomputeTotals();
+    return;
+  }
+  std::vector<TreePiece<Directory>> pieces = partitionTree(root, grain);
+  // 펼친 디렉터리(와 root의 조상)의 해시 캐시를 먼저 버려 두면, 작업 안의 invalidateContentHash()는
+  // 자기 묶음 밖으로 올라가지 않으므로 스레드끼리 같은 노드를 고치지 않음
+  for (const TreePiece<Directory> &piece: pieces) {
+    if (piece.kind == TreePiece<Directory>::Open) { piece.dir->invalidateContentHash(); }
+  }
+  WorkStealingPool pool(threadCount);
+  for (const TreePiece<Directory> &piece: pieces) {
+    if (piece.kind != TreePiece<Directory>::Range) { continue; }
+    pool.submit([&piece] {
+      for (size_t k = piece.begin; k < piece.end; ++k) {
+        FilesystemComponent *child = piece.dir->getChildren()[k];
+        if (child->isDirectory()) { static_cast<Directory *>(child)->recomputeTotals(); }
+      }
+    });
+  }
+  pool.run();
+  for (const TreePiece<Directory> &piece: pieces) {
+    if (piece.kind == TreePiece<Directory>::Close) { piece.dir->recomputeLocalTotals(); }
+  }
+}
+
+// 크기 상위 K개 질의. 어떤 종류의 노드를 셀지
+enum class TopKKind { Files, Directories, All };
+
+struct SizeRank {
+  const FilesystemComponent *node;
+  long long size;
+};
+
+// root 하위(root 자신 제외)에서 크기가 가장 큰 노드 k개를 큰 순서로 반환
+// 크기가 큰 디렉터리부터 펼치고(best-first), 캐시된 합계가 현재 k번째보다 크지 않은 하위 트리는 열지 않음
+// 하위 트리 합계는 그 안의 어떤 노드 크기보다도 작지 않으므로 잘라 내도 결과가 바뀌지 않음 (크기가 같으면 먼저 찾은 쪽이 남음)
+// threadCount > 1이면 루트의 하위 디렉터리마다 따로 찾고 합침. 이때 스레드끼리 k번째 하한을 공유해서 같이 잘라 냄
+class TopKQuery {
+  private:
+    struct BySizeDesc {
+      bool operator()(const SizeRank &a, const SizeRank &b) const { return a.size > b.size; }
+    };
+    struct ByTotalAsc {
+      bool operator()(const Directory *a, const Directory *b) const { return a->getSize() < b->getSize(); }
+    };
+    using MinHeap = std::priority_queue<SizeRank, std::vector<SizeRank>, BySizeDesc>;
+
+    size_t k;
+    TopKKind kind;
+    std::atomic<long long> sharedBound{-1};  // 어느 한 힙이 꽉 찼을 때의 최솟값 중 가장 큰 값
+
+    bool counts(const FilesystemComponent &node) const {
+      return kind == TopKKind::All || node.isDirectory() == (kind == TopKKind::Directories);
+    }
+
+    long long bound(const MinHeap &heap) const {
+      long long local = heap.size() == k ? heap.top().size : -1;
+      return std::max(local, sharedBound.load(std::memory_order_relaxed));
+    }
+
+    void offer(MinHeap &heap, const FilesystemComponent &node) {
+      if (!counts(node)) { return; }
+      long long size = node.getSize();
+      if (size <= sharedBound.load(std::memory_order_relaxed)) { return; }
+      if (heap.size() == k) {
+        if (size <= heap.top().size) { return; }
+        heap.pop();
+      }
+      heap.push({&node, size});
+      if (heap.size() == k) {
+        long long local = heap.top().size;
+        long long seen = sharedBound.load(std::memory_order_relaxed);
+        while (local > seen && !sharedBound.compare_exchange_weak(seen, local, std::memory_order_relaxed)) {}
+      }
+    }
+
+    // start 하위를 best-first로 훑음 (start 자신은 넣지 않음)
+    void search(const Directory &start, MinHeap &heap) {
+      std::priority_queue<const Directory *, std::vector<const Directory *>, ByTotalAsc> frontier;
+      frontier.push(&start);
+      while (!frontier.empty()) {
+        const Directory *dir = frontier.top();
+        frontier.pop();
+        // 남은 하위 트리는 모두 이보다 작으므로 여기서 끝
+        if (dir->getSize() <= bound(heap)) { break; }
+        for (const FilesystemComponent *child: dir->getChildren()) {
+          offer(heap, *child);
+          if (child->isDirectory() && child->getSize() > bound(heap)) {
+            frontier.push(static_cast<const Directory *>(child));
+          }
+        }
+      }
+    }
+
+    static std::vector<SizeRank> drain(MinHeap &heap) {
+      std::vector<SizeRank> result;
+      result.reserve(heap.size());
+      while (!heap.empty()) {
+        result.push_back(heap.top());
+        heap.pop();
+      }
+      std::reverse(result.begin(), result.end());
+      return result;
+    }
+
   public:
-    FilesystemComponent(const std::string &n): name(n) {}
-    virtual ~FilesystemComponent() = default;
-    // 이름과 크기 출력
-    virtual void display(int indent = 0) = 0;
-    virtual long long getSize() = 0;
-    virtual std::string getName() const { return name; }
+    TopKQuery(size_t count, TopKKind nodeKind): k(count), kind(nodeKind) {}
 
-    // 과제2
-    virtual std::string serialize() const = 0;
-    virtual void deserialize(const std::string& data) = 0;
+    std::vector<SizeRank> run(const Directory &root, unsigned threadCount = 0) {
+      if (k == 0) { return {}; }
+      if (threadCount <= 1) {
+        MinHeap heap;
+        search(root, heap);
+        return drain(heap);
+      }
+
+      // 루트 바로 아래 항목은 여기서 처리하고, 하위 디렉터리마다 작업 하나씩
+      MinHeap top;
+      std::vector<const Directory *> subDirs;
+      for (const FilesystemComponent *child: root.getChildren()) {
+        offer(top, *child);
+        if (child->isDirectory()) { subDirs.push_back(static_cast<const Directory *>(child)); }
+      }
+      std::sort(subDirs.begin(), subDirs.end(), [](const Directory *a, const Directory *b) { return a->getSize() > b->getSize(); });
+      std::vector<MinHeap> heaps(subDirs.size());
+      WorkStealingPool pool(threadCount);
+      for (size_t i = 0; i < subDirs.size(); ++i) {
+        pool.submit([this, &subDirs, &heaps, i] {
+          if (subDirs[i]->getSize() <= sharedBound.load(std::memory_order_relaxed)) { return; }
+          search(*subDirs[i], heaps[i]);
+        });
+      }
+      pool.run();
+      // 합칠 때는 공유 하한을 쓰지 않음 (k개를 채우는 데 필요한 노드가 잘려 나가지 않도록)
+      sharedBound = -1;
+      for (MinHeap &heap: heaps) {
+        while (!heap.empty()) {
+          offer(top, *heap.top().node);
+          heap.pop();
+        }
+      }
+      return drain(top);
+    }
+};
+
+// 두 트리의 차이 한 줄
+struct DiffEntry {
+  enum Kind { Added, Removed, Resized };
+  Kind kind;
+  std::string path;  // 트리 루트 기준 "a/b/c"
+  bool isDirectory;  // Added/Removed에서 하위 트리 전체가 더해지거나 빠진 것인지
+  long long oldSize;
+  long long newSize;
+  long long delta() const { return newSize - oldSize; }
 };
 
-class File : public FilesystemComponent {
+// 두 트리를 자식 이름순으로 나란히 내려가면서 달라진 경로만 모음
+// 같은 이름의 디렉터리는 내용 해시가 같으면 열지 않으므로, 바뀌지 않은 하위 트리는 O(1)에 건너뜀
+// 추가/삭제된 디렉터리는 하위 트리 전체를 한 줄로 보고함 (종류가 바뀐 항목은 삭제 + 추가)
+std::vector<DiffEntry> diffTrees(const Directory &oldRoot, const Directory &newRoot) {
+  auto sortedChildren = [](const Directory &dir) {
+    std::vector<const FilesystemComponent *> sorted(dir.getChildren().begin(), dir.getChildren().end());
+    std::sort(sorted.begin(), sorted.end(), [](const FilesystemComponent *a, const FilesystemComponent *b) {
+      return a->getNameView() < b->getNameView();
+    });
+    return sorted;
+  };
+  auto report = [](std::vector<DiffEntry> &out, DiffEntry::Kind kind, const std::string &path,
+                   const FilesystemComponent &node) {
+    long long size = node.getSize();
+    out.push_back({kind, path, node.isDirectory(), kind == DiffEntry::Added ? 0 : size, kind == DiffEntry::Added ? size : 0});
+  };
+
+  std::vector<DiffEntry> result;
+  std::vector<std::tuple<const Directory *, const Directory *, std::string>> pending;
+  pending.emplace_back(&oldRoot, &newRoot, "");
+  while (!pending.empty()) {
+    auto [oldDir, newDir, base] = std::move(pending.back());
+    pending.pop_back();
+    if (oldDir->isCollapsed() || newDir->isCollapsed()) {
+      // 접힌 디렉터리는 자식이 없으므로 합계만 비교
+      if (oldDir->getSize() != newDir->getSize()) {
+        result.push_back({DiffEntry::Resized, base.empty() ? "." : base, true, oldDir->getSize(), newDir->getSize()});
+      }
+      continue;
+    }
+    if (oldDir->getContentHash() == newDir->getContentHash()) { continue; }
+
+    std::vector<const FilesystemComponent *> before = sortedChildren(*oldDir);
+    std::vector<const FilesystemComponent *> after = sortedChildren(*newDir);
+    std::string prefix = base.empty() ? "" : base + "/";
+    size_t i = 0;
+    size_t j = 0;
+    while (i < before.size() || j < after.size()) {
+      int order = i == before.size() ? 1 : j == after.size() ? -1 : before[i]->getNameView().compare(after[j]->getNameView());
+      if (order < 0) {
+        report(result, DiffEntry::Removed, prefix + std::string(before[i]->getNameView()), *before[i]);
+        ++i;
+        continue;
+      }
+      if (order > 0) {
+        report(result, DiffEntry::Added, prefix + std::string(after[j]->getNameView()), *after[j]);
+        ++j;
+        continue;
+      }
+      const FilesystemComponent &a = *before[i++];
+      const FilesystemComponent &b = *after[j++];
+      std::string path = prefix + std::string(a.getNameView());
+      if (a.isDirectory() != b.isDirectory()) {
+        report(result, DiffEntry::Removed, path, a);
+        report(result, DiffEntry::Added, path, b);
+      } else if (a.isDirectory()) {
+        pending.emplace_back(static_cast<const Directory *>(&a), static_cast<const Directory *>(&b), std::move(path));
+      } else if (a.getSize() != b.getSize()) {
+        result.push_back({DiffEntry::Resized, std::move(path), false, a.getSize(), b.getSize()});
+      }
+    }
+  }
+  std::sort(result.begin(), result.end(), [](const DiffEntry &a, const DiffEntry &b) { return a.path < b.path; });
+  return result;
+}
+
+// root 기준 경로 ("a/b/c", root 자신은 ".")
+std::string treePathOf(const FilesystemComponent &node, const FilesystemComponent &root) {
+  std::vector<std::string_view> names;
+  for (const FilesystemComponent *n = &node; n && n != &root; n = n->getParent()) { names.push_back(n->getNameView()); }
+  if (names.empty()) { return "."; }
+  std::string result;
+  for (auto it = names.rbegin(); it != names.rend(); ++it) {
+    if (!result.empty()) { result.push_back('/'); }
+    result.append(it->data(), it->size());
+  }
+  return result;
+}
+
+// 여러 스레드가 읽는 불변 트리 사본 (게시된 뒤에는 바뀌지 않으므로 잠금 없이 읽음)
+// 자식 순서는 원본 Directory와 같아서 display() 출력도 같음. 하위 디렉터리는 다음 사본과 공유될 수 있음
+class FrozenDirectory {
+  public:
+    struct Entry {
+      std::string name;
+      long long size;
+      std::shared_ptr<const FrozenDirectory> dir;  // 파일이면 nullptr
+    };
+
   private:
-    long long size;
+    // 자식이 이보다 많으면 이름순 색인으로 이분 탐색
+    static constexpr size_t sortedIndexThreshold = 8;
+
+    std::string name;
+    long long totalSize = 0;
+    long long fileCount = 0;
+    long long dirCount = 0;
+    uint64_t revision = 0;  // 원본 Directory::getRevision() (다음 게시에서 재사용 판단용)
+    std::vector<Entry> entries;
+    std::vector<uint32_t> byName;  // entries의 이름순 위치 (자식이 적으면 비어 있음)
+
+    friend class TreePublisher;
+
   public:
-    File(const std::string &n, long long s): FilesystemComponent(n), size(s) {}
-    // 이름과 크기 출력 (override 함)
-    void display(int indent = 0) override {
-      std::cout << std::string(indent * 2, ' ')
-              << getName() << " (" << size << " bytes)" << std::endl;
+    FrozenDirectory(std::string n, uint64_t rev, std::vector<Entry> children)
+        : name(std::move(n)), revision(rev), entries(std::move(children)) {
+      for (const Entry &entry: entries) {
+        totalSize += entry.size;
+        if (entry.dir) {
+          fileCount += entry.dir->fileCount;
+          dirCount += entry.dir->dirCount + 1;
+        } else {
+          ++fileCount;
+        }
+      }
+      if (entries.size() > sortedIndexThreshold) {
+        byName.resize(entries.size());
+        std::iota(byName.begin(), byName.end(), 0u);
+        std::sort(byName.begin(), byName.end(), [this](uint32_t a, uint32_t b) { return entries[a].name < entries[b].name; });
+      }
     }
 
-    long long getSize() override { return size; }
+    std::string_view getNameView() const { return name; }
+    long long getSize() const { return totalSize; }
+    long long getFileCount() const { return fileCount; }
+    long long getDirectoryCount() const { return dirCount; }
+    const std::vector<Entry> &getEntries() const { return entries; }
 
-    // 과제2
-    std::string serialize() const override {
-      std::ostringstream oss;
-      oss << "F|" << getName() << "|" << size;
-      return oss.str();
+    const Entry *findEntry(std::string_view childName) const {
+      if (byName.empty()) {
+        for (const Entry &entry: entries) {
+          if (entry.name == childName) { return &entry; }
+        }
+        return nullptr;
+      }
+      auto found = std::lower_bound(byName.begin(), byName.end(), childName,
+                                    [this](uint32_t index, std::string_view key) { return entries[index].name < key; });
+      return found != byName.end() && entries[*found].name == childName ? &entries[*found] : nullptr;
     }
 
-    void deserialize(const std::string& data) override {
-      std::istringstream iss(data.substr(2));
-      std::string name_str;
-      std::string size_str;
+    // 이 디렉터리 기준 경로("a/b/c")의 크기. 없는 경로면 nullopt
+    std::optional<long long> getSize(std::string_view path) const {
+      const FrozenDirectory *dir = this;
+      long long size = totalSize;
+      size_t pos = 0;
+      while (pos <= path.size()) {
+        size_t end = std::min(path.find('/', pos), path.size());
+        std::string_view part = path.substr(pos, end - pos);
+        pos = end + 1;
+        if (part.empty() || part == ".") { continue; }
+        const Entry *entry = dir ? dir->findEntry(part) : nullptr;
+        if (!entry) { return std::nullopt; }
+        size = entry->size;
+        dir = entry->dir.get();
+      }
+      return size;
+    }
 
-      if (std::getline(iss, name_str, '|') && std::getline(iss, size_str)) {
-        this->name = name_str;
-        this->size = std::stoll(size_str);
+    void display(OutputSink &sink, int indent = 0) const {
+      writeDisplayLine(sink, indent, name, totalSize, true);
+      std::vector<std::pair<const FrozenDirectory *, size_t>> stack{{this, 0}};
+      while (!stack.empty()) {
+        auto &[dir, next] = stack.back();
+        if (next == dir->entries.size()) {
+          stack.pop_back();
+          continue;
+        }
+        const Entry &entry = dir->entries[next++];
+        writeDisplayLine(sink, indent + static_cast<int>(stack.size()), entry.name, entry.size, entry.dir != nullptr);
+        if (entry.dir) { stack.push_back({entry.dir.get(), 0}); }
       }
     }
 };
 
-class Directory : public FilesystemComponent {
+// 쓰는 스레드 하나가 원본 트리를 고치고 publish()하면, 읽는 스레드들은 snapshot()으로 마지막 사본을 받아 씀
+// 읽기는 항상 한 시점의 일관된 트리를 보고, 원본 트리 수정이나 publish()의 사본 만들기가 끝나기를 기다리지 않음
+// 단 lock-free는 아님: libstdc++의 shared_ptr용 atomic_load/atomic_store는 주소로 고른 전역 spinlock을 잡으므로,
+// 읽기는 같은 잠금을 잡은 다른 읽기나 게시의 포인터 교체(참조 수 복사 한 번 길이)와 잠깐 겹칠 수 있음
+// 옛 사본의 해제는 잠금을 놓은 뒤에 일어나므로 잠금 구간은 트리 크기와 무관함
+// 바뀌지 않은 하위 트리(이전 사본의 같은 자리에 같은 이름으로 있고 revision이 같은 디렉터리)는 이전 사본의 노드를
+// 그대로 공유하므로 게시 비용은 바뀐 디렉터리 수에 비례함. 옛 사본은 마지막으로 들고 있던 읽기가 놓을 때 해제됨 (참조 수로 회수)
+// publish()는 원본 트리를 고치는 스레드에서만 불러야 함 (지연 디렉터리는 이때 모두 펼쳐짐)
+class TreePublisher {
   private:
-    std::vector<FilesystemComponent *> children;
+    const Directory &source;
+    std::shared_ptr<const FrozenDirectory> current;  // std::atomic_load/atomic_store로만 다룸
+
   public:
-    Directory(const std::string &n): FilesystemComponent(n) {}
-    ~Directory() override {
-      for (FilesystemComponent *child: children) { delete child; }
+    size_t reusedDirectories = 0;   // 마지막 publish()에서 공유한 디렉터리 수
+    size_t rebuiltDirectories = 0;  // 마지막 publish()에서 새로 만든 디렉터리 수
+
+    explicit TreePublisher(const Directory &root): source(root) { publish(); }
+    TreePublisher(const TreePublisher &) = delete;
+    TreePublisher &operator=(const TreePublisher &) = delete;
+
+    void publish() {
+      reusedDirectories = rebuiltDirectories = 0;
+      source.getContentHash();  // 해시 캐시를 채워 두어야 이후의 변경이 revision을 바꿈
+
+      // 이전 사본은 원본과 나란히 내려가며 이름으로 찾으므로, 떼어 내거나 해제된 디렉터리의 사본은 따로 들고 있지 않음
+      struct Frame {
+        const FrozenDirectory *previous;  // 이전 사본에서 같은 자리의 디렉터리 (없으면 nullptr)
+        std::vector<FrozenDirectory::Entry> entries;
+      };
+      std::vector<Frame> stack;
+      std::shared_ptr<const FrozenDirectory> root;
+      std::shared_ptr<const FrozenDirectory> previousRoot = snapshot();
+      auto previousOf = [&](const Directory &dir) -> const std::shared_ptr<const FrozenDirectory> * {
+        if (stack.empty()) { return previousRoot ? &previousRoot : nullptr; }
+        const FrozenDirectory *parent = stack.back().previous;
+        const FrozenDirectory::Entry *entry = parent ? parent->findEntry(dir.getNameView()) : nullptr;
+        return entry && entry->dir ? &entry->dir : nullptr;
+      };
+      traverseTree(source,
+                   [&](const FilesystemComponent &node, int) {
+                     if (!node.isDirectory()) {
+                       stack.back().entries.push_back({std::string(node.getNameView()), node.getSize(), nullptr});
+                       return true;
+                     }
+                     const Directory &dir = static_cast<const Directory &>(node);
+                     const std::shared_ptr<const FrozenDirectory> *previous = previousOf(dir);
+                     if (previous && (*previous)->revision == dir.getRevision() && (*previous)->name == dir.getNameView()) {
+                       ++reusedDirectories;
+                       if (stack.empty()) {
+                         root = *previous;
+                       } else {
+                         stack.back().entries.push_back({(*previous)->name, (*previous)->totalSize, *previous});
+                       }
+                       return false;
+                     }
+                     stack.push_back({previous ? previous->get() : nullptr, {}});
+                     stack.back().entries.reserve(dir.getChildren().size());
+                     return true;
+                   },
+                   [&](const Directory &dir, int) {
+                     ++rebuiltDirectories;
+                     auto copy = std::make_shared<const FrozenDirectory>(std::string(dir.getNameView()), dir.getRevision(),
+                                                                         std::move(stack.back().entries));
+                     stack.pop_back();
+                     if (stack.empty()) {
+                       root = std::move(copy);
+                     } else {
+                       stack.back().entries.push_back({copy->name, copy->totalSize, std::move(copy)});
+                     }
+                   });
+      std::atomic_store(&current, std::shared_ptr<const FrozenDirectory>(std::move(root)));
+    }
+
+    // 아무 스레드에서나 부를 수 있음. 받은 사본은 들고 있는 동안 바뀌거나 해제되지 않음 (기다림은 위 설명의 짧은 잠금뿐)
+    std::shared_ptr<const FrozenDirectory> snapshot() const { return std::atomic_load(&current); }
+};
+
+// LZ4 블록 형식과 같은 방식의 LZ77 압축 (외부 라이브러리 없이)
+//   시퀀스: 토큰(상위 4비트 리터럴 길이, 하위 4비트 일치 길이 - 4) | 추가 리터럴 길이 | 리터럴 | u16 거리 | 추가 일치 길이
+//   길이가 15 이상이면 255씩 이어지는 바이트로 늘림. 마지막 시퀀스는 리터럴만 있음
+// 블록 하나는 다른 블록과 무관하게 풀 수 있으므로 블록 단위로 병렬 처리할 수 있음
+namespace blockcodec {
+
+constexpr size_t minMatch = 4;
+constexpr size_t lastLiterals = 5;     // 블록 끝의 이만큼은 항상 리터럴로 둠
+constexpr size_t maxDistance = 65535;
+constexpr int hashBits = 14;
+// 압축한 바이트 하나가 풀려서 될 수 있는 최대 바이트 수 (읽는 쪽의 크기 검사용)
+// 일치 하나는 토큰과 거리 3바이트에 길이 바이트 m개로 최대 255m + 18바이트가 되고, 리터럴은 1:1이므로 항상 255배 미만
+constexpr size_t maxExpansion = 255;
+
+inline uint32_t read32(const char *p) {
+  uint32_t value;
+  std::memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+inline void appendLength(std::string &out, size_t length) {
+  while (length >= 255) {
+    out.push_back(static_cast<char>(255));
+    length -= 255;
+  }
+  out.push_back(static_cast<char>(length));
+}
+
+inline void appendSequence(std::string &out, const char *literals, size_t literalLength, size_t distance, size_t matchLength) {
+  size_t matchCode = matchLength ? matchLength - minMatch : 0;
+  out.push_back(static_cast<char>((std::min<size_t>(literalLength, 15) << 4) | std::min<size_t>(matchCode, 15)));
+  if (literalLength >= 15) { appendLength(out, literalLength - 15); }
+  out.append(literals, literalLength);
+  if (matchLength == 0) { return; }
+  out.push_back(static_cast<char>(distance & 0xff));
+  out.push_back(static_cast<char>(distance >> 8));
+  if (matchCode >= 15) { appendLength(out, matchCode - 15); }
+}
+
+// input을 압축해서 out 뒤에 붙임
+inline void compress(std::string_view input, std::string &out) {
+  std::vector<uint32_t> table(size_t(1) << hashBits, UINT32_MAX);
+  const char *base = input.data();
+  size_t size = input.size();
+  size_t anchor = 0;
+  size_t pos = 0;
+  if (size > minMatch + lastLiterals) {
+    size_t limit = size - lastLiterals - minMatch;
+    while (pos <= limit) {
+      uint32_t sequence = read32(base + pos);
+      uint32_t slot = (sequence * 2654435761u) >> (32 - hashBits);
+      uint32_t candidate = table[slot];
+      table[slot] = static_cast<uint32_t>(pos);
+      if (candidate == UINT32_MAX || pos - candidate > maxDistance || read32(base + candidate) != sequence) {
+        ++pos;
+        continue;
+      }
+      size_t matchLength = minMatch;
+      size_t matchLimit = size - lastLiterals;
+      while (pos + matchLength < matchLimit && base[candidate + matchLength] == base[pos + matchLength]) { ++matchLength; }
+      appendSequence(out, base + anchor, pos - anchor, pos - candidate, matchLength);
+      pos += matchLength;
+      anchor = pos;
     }
-    // 이 디렉터리에 파일, 하위 디렉터리 추가
-    void add(FilesystemComponent *component) {
-      if (component) { children.push_back(component); }
+  }
+  appendSequence(out, base + anchor, size - anchor, 0, 0);
+}
+
+// compress()로 만든 블록을 풀어서 정확히 rawSize 바이트를 out에 씀. 잘못된 입력이면 DeserializeError (offset은 블록 안 위치)
+inline void decompress(std::string_view input, char *out, size_t rawSize) {
+  size_t in = 0;
+  size_t written = 0;
+  auto fail = [&](const char *message) { throw DeserializeError(message, in); };
+  auto readLength = [&](size_t length) {
+    if (length != 15) { return length; }
+    while (true) {
+      if (in >= input.size()) { fail("truncated length"); }
+      unsigned char byte = static_cast<unsigned char>(input[in++]);
+      length += byte;
+      if (byte != 255) { return length; }
     }
+  };
+  while (in < input.size()) {
+    unsigned char token = static_cast<unsigned char>(input[in++]);
+    size_t literalLength = readLength(token >> 4);
+    if (literalLength > input.size() - in || literalLength > rawSize - written) { fail("literal overruns block"); }
+    std::memcpy(out + written, input.data() + in, literalLength);
+    in += literalLength;
+    written += literalLength;
+    if (in == input.size()) { break; }  // 마지막 시퀀스
+    if (input.size() - in < 2) { fail("truncated match offset"); }
+    size_t distance = static_cast<unsigned char>(input[in]) | (static_cast<size_t>(static_cast<unsigned char>(input[in + 1])) << 8);
+    in += 2;
+    size_t matchLength = readLength(token & 0x0f) + minMatch;
+    if (distance == 0 || distance > written) { fail("match offset out of range"); }
+    if (matchLength > rawSize - written) { fail("match overruns block"); }
+    // 겹치는 복사(거리 < 길이)가 있으므로 바이트 단위로
+    const char *from = out + written - distance;
+    for (size_t i = 0; i < matchLength; ++i) { out[written + i] = from[i]; }
+    written += matchLength;
+  }
+  if (written != rawSize) { fail("block size mismatch"); }
+}
 
-    long long getSize() override {
-      long long totalSize = 0;
-      for (FilesystemComponent *child: children) {
-        if (child) { totalSize += child->getSize(); }
+}  // namespace blockcodec
+
+// 압축 스냅샷 (버전 1, 정수는 little-endian)
+//   헤더: "FSNZ" | u32 version | u32 blockSize
+//   블록마다: u32 rawBytes | u32 storedBytes | 데이터 (storedBytes == rawBytes면 압축하지 않고 그대로 둔 것)
+//     rawBytes는 blockSize 이하 (마지막 블록 말고는 정확히 blockSize). 레코드는 블록 경계에 걸쳐도 됨
+//   끝: u32 0 | u32 0 | u64 blockCount | u64 totalRawBytes
+// 블록을 풀어 이은 내용은 전위 순서의 노드 레코드이고, 이름은 바로 앞 형제 이름과 겹치는 앞부분을 뺀 나머지만 저장(front coding)
+//   'D' | varint shared | varint suffixLength | suffix | varint childCount
+//   'F' | varint shared | varint suffixLength | suffix | varint size
+// 디렉터리가 닫히는 자리는 자식 수로 알 수 있으므로 따로 적지 않음
+constexpr char compressedSnapshotMagic[4] = {'F', 'S', 'N', 'Z'};
+constexpr uint32_t compressedSnapshotVersion = 1;
+
+// builder 이벤트(beginDirectory/addFile/endDirectory)를 받아 압축 스냅샷을 sink에 흘려 씀
+// 블록을 threadCount * 4개씩 모았다가 한꺼번에 병렬로 압축하므로 메모리는 그만큼만 씀
+class CompressedSnapshotWriter {
+  private:
+    OutputSink &sink;
+    size_t blockSize;
+    unsigned threadCount;
+    std::vector<std::string> pendingBlocks;  // 아직 압축하지 않은 원본 블록
+    std::string current;                     // 채우는 중인 블록
+    std::vector<std::string> previousSibling{std::string()};  // 깊이마다 바로 앞 형제 이름
+    uint64_t blockCount = 0;
+    uint64_t rawBytes = 0;
+
+    void appendName(std::string_view nodeName) {
+      std::string &previous = previousSibling.back();
+      size_t shared = 0;
+      size_t limit = std::min(previous.size(), nodeName.size());
+      while (shared < limit && previous[shared] == nodeName[shared]) { ++shared; }
+      appendVarint(current, shared);
+      appendVarint(current, nodeName.size() - shared);
+      current.append(nodeName.data() + shared, nodeName.size() - shared);
+      previous.assign(nodeName.data(), nodeName.size());
+    }
+
+    // 읽는 쪽은 풀린 블록을 이어 붙여 읽으므로 레코드 중간에서 잘라도 됨. 그래서 블록 원본은 blockSize를 넘지 않음
+    void endRecord() {
+      while (current.size() >= blockSize) {
+        std::string rest;
+        rest.reserve(blockSize + 64);
+        rest.assign(current, blockSize, std::string::npos);
+        current.resize(blockSize);
+        pendingBlocks.push_back(std::move(current));
+        current = std::move(rest);
+        if (pendingBlocks.size() >= static_cast<size_t>(threadCount) * 4) { flushBlocks(); }
       }
-      return totalSize;
     }
-    // 디렉터리 이름과 디렉터리에 포함된 모든 파일의 크기 합
-    void display(int indent = 0) override {
-      std::cout << std::string(indent*2, ' ');
-      if (getName() == ".") {
-        std::cout << getName() << "/ (total" << getSize() << "bytes)" << std::endl;
+
+    void flushBlocks() {
+      std::vector<std::string> packed(pendingBlocks.size());
+      WorkStealingPool pool(threadCount);
+      for (size_t i = 0; i < pendingBlocks.size(); ++i) {
+        pool.submit([this, &packed, i] { blockcodec::compress(pendingBlocks[i], packed[i]); });
+      }
+      pool.run();
+      for (size_t i = 0; i < pendingBlocks.size(); ++i) {
+        const std::string &raw = pendingBlocks[i];
+        const std::string &stored = packed[i].size() < raw.size() ? packed[i] : raw;
+        std::string header;
+        appendFixed(header, raw.size(), 4);
+        appendFixed(header, stored.size(), 4);
+        sink.write(header);
+        sink.write(stored);
+        ++blockCount;
+        rawBytes += raw.size();
+      }
+      pendingBlocks.clear();
+    }
+
+  public:
+    CompressedSnapshotWriter(OutputSink &s, unsigned threads = 1, size_t block = 1 << 20)
+        : sink(s), blockSize(std::clamp<size_t>(block, 64, UINT32_MAX)), threadCount(std::max(1u, threads)) {
+      std::string header(compressedSnapshotMagic, sizeof(compressedSnapshotMagic));
+      appendFixed(header, compressedSnapshotVersion, 4);
+      appendFixed(header, blockSize, 4);
+      sink.write(header);
+      current.reserve(blockSize + 64);
+    }
+
+    void beginDirectory(std::string_view dirName, long long childCount) {
+      current.push_back('D');
+      appendName(dirName);
+      appendVarint(current, static_cast<uint64_t>(childCount));
+      previousSibling.emplace_back();
+      endRecord();
+    }
+    void addFile(std::string_view fileName, long long fileSize) {
+      current.push_back('F');
+      appendName(fileName);
+      appendVarint(current, static_cast<uint64_t>(fileSize));
+      endRecord();
+    }
+    void endDirectory() { previousSibling.pop_back(); }
+
+    // 남은 블록과 끝 표시를 씀 (sink의 flush는 호출한 쪽이 함)
+    void finish() {
+      if (!current.empty()) {
+        pendingBlocks.push_back(std::move(current));
+        current.clear();
+      }
+      flushBlocks();
+      std::string trailer;
+      appendFixed(trailer, 0, 4);
+      appendFixed(trailer, 0, 4);
+      appendFixed(trailer, blockCount, 8);
+      appendFixed(trailer, rawBytes, 8);
+      sink.write(trailer);
+    }
+
+    // 노드 트리 하나를 통째로 씀
+    void write(const Directory &root) {
+      traverseTree(root,
+                   [this](const FilesystemComponent &node, int) {
+                     if (node.isDirectory()) {
+                       if (static_cast<const Directory &>(node).isCollapsed()) {
+                         throw std::runtime_error("compressed snapshot cannot hold directories collapsed by --max-depth");
+                       }
+                       beginDirectory(node.getNameView(), static_cast<long long>(static_cast<const Directory &>(node).getChildren().size()));
+                     } else {
+                       addFile(node.getNameView(), node.getSize());
+                     }
+                     return true;
+                   },
+                   [this](const Directory &, int) { endDirectory(); });
+      finish();
+    }
+};
+
+// 압축 스냅샷 전체를 블록 단위로 병렬로 풀고, 레코드를 읽으면서 builder에 전위 순서로 알림
+// 잘못된 입력이면 DeserializeError (offset은 파일 안 위치, 블록 안에서 난 오류는 그 블록의 시작 위치)
+// 풀 공간은 헤더의 크기를 믿지 않고, 블록마다 blockSize와 storedBytes * maxExpansion 이하인지 확인한 뒤에 잡음
+// (그래서 잡는 크기는 파일 크기 * maxExpansion을 넘지 않음)
+template <typename Builder>
+void readCompressedSnapshot(std::string_view data, Builder &builder, unsigned threadCount = 1) {
+  auto readFixed = [&data](size_t offset, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i) { value |= static_cast<uint64_t>(static_cast<unsigned char>(data[offset + i])) << (8 * i); }
+    return value;
+  };
+  constexpr size_t headerBytes = 12;
+  if (data.size() < headerBytes || data.substr(0, 4) != std::string_view(compressedSnapshotMagic, 4)) {
+    throw DeserializeError("not a compressed snapshot", 0);
+  }
+  if (readFixed(4, 4) != compressedSnapshotVersion) { throw DeserializeError("unsupported compressed snapshot version", 4); }
+  size_t blockSize = readFixed(8, 4);
+  if (blockSize == 0) { throw DeserializeError("bad block size", 8); }
+
+  // 1) 블록 위치 모으기
+  struct Block {
+    size_t offset;
+    size_t rawBytes;
+    size_t storedBytes;
+    size_t rawOffset;
+  };
+  std::vector<Block> blocks;
+  size_t pos = headerBytes;
+  size_t totalRaw = 0;
+  while (true) {
+    if (data.size() - pos < 8) { throw DeserializeError("truncated block header", pos); }
+    size_t raw = readFixed(pos, 4);
+    size_t stored = readFixed(pos + 4, 4);
+    pos += 8;
+    if (raw == 0 && stored == 0) { break; }
+    if (stored > data.size() - pos || stored > raw) { throw DeserializeError("block overruns file", pos); }
+    if (raw > blockSize || raw > stored * blockcodec::maxExpansion) { throw DeserializeError("block too large", pos - 8); }
+    blocks.push_back({pos, raw, stored, totalRaw});
+    totalRaw += raw;
+    pos += stored;
+  }
+  if (data.size() - pos != 16) { throw DeserializeError("bad trailer", pos); }
+  if (readFixed(pos, 8) != blocks.size() || readFixed(pos + 8, 8) != totalRaw) {
+    throw DeserializeError("trailer does not match blocks", pos);
+  }
+  // 블록마다 확인했으므로 합계도 파일 크기 * maxExpansion 이하
+  if (totalRaw / blockcodec::maxExpansion > data.size()) { throw DeserializeError("snapshot too large", pos); }
+
+  // 2) 병렬로 풀기
+  std::string raw(totalRaw, '\0');
+  WorkStealingPool pool(std::max(1u, threadCount));
+  for (const Block &block: blocks) {
+    pool.submit([&data, &raw, &block] {
+      std::string_view stored = data.substr(block.offset, block.storedBytes);
+      if (block.storedBytes == block.rawBytes) {
+        std::memcpy(&raw[block.rawOffset], stored.data(), stored.size());
+        return;
+      }
+      try {
+        blockcodec::decompress(stored, &raw[block.rawOffset], block.rawBytes);
+      } catch (const DeserializeError &) {
+        throw DeserializeError("corrupt block", block.offset);
+      }
+    });
+  }
+  pool.run();
+
+  // 3) 레코드 읽기 (위치는 풀린 내용 기준)
+  size_t at = 0;
+  auto fail = [&at](const char *message) { throw DeserializeError(std::string(message) + " in records", at); };
+  auto varint = [&]() {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      if (at >= raw.size()) { fail("truncated record"); }
+      unsigned char byte = static_cast<unsigned char>(raw[at++]);
+      value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if (!(byte & 0x80)) { return value; }
+    }
+    fail("varint too long");
+    return value;
+  };
+  struct Open {
+    uint64_t remaining;
+    std::string previous;  // 바로 앞 자식 이름
+  };
+  std::vector<Open> open;
+  std::string rootPrevious;
+  auto readRecord = [&](bool isRoot) {
+    if (at >= raw.size()) { fail("unexpected end"); }
+    char tag = raw[at++];
+    if (tag != 'D' && tag != 'F') { fail("expected 'F' or 'D'"); }
+    if (isRoot && tag != 'D') { fail("root is not a directory"); }
+    std::string &previous = isRoot ? rootPrevious : open.back().previous;
+    uint64_t shared = varint();
+    uint64_t suffix = varint();
+    if (shared > previous.size() || suffix > raw.size() - at) { fail("bad name"); }
+    previous.resize(shared);
+    previous.append(raw, at, suffix);
+    at += suffix;
+    uint64_t value = varint();
+    if (!isRoot) { --open.back().remaining; }
+    if (tag == 'F') {
+      builder.addFile(previous, static_cast<long long>(value));
+    } else {
+      builder.beginDirectory(previous, static_cast<long long>(value));
+      open.push_back({value, std::string()});
+    }
+  };
+  readRecord(true);
+  while (!open.empty()) {
+    if (open.back().remaining == 0) {
+      open.pop_back();
+      builder.endDirectory();
+      continue;
+    }
+    readRecord(false);
+  }
+  if (at != raw.size()) { fail("unexpected trailing data"); }
+}
+
+inline bool hasCompressedSnapshotMagic(std::string_view data) {
+  return data.substr(0, sizeof(compressedSnapshotMagic)) == std::string_view(compressedSnapshotMagic, sizeof(compressedSnapshotMagic));
+}
+
+// 앞 4바이트가 바이너리 스냅샷 표시인지 보고 처음 위치로 되돌림 (바이너리는 mmap으로 읽으므로 내용을 읽어 들이지 않음)
+inline bool startsWithBinarySnapshotMagic(std::istream &in) {
+  char magic[sizeof(binarySnapshotMagic)] = {};
+  in.read(magic, sizeof(magic));
+  bool binary = in.gcount() == sizeof(magic) && std::equal(magic, magic + sizeof(magic), binarySnapshotMagic);
+  in.clear();
+  in.seekg(0);
+  return binary;
+}
+
+std::unique_ptr<LazySnapshotTree> LazySnapshotTree::open(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) { throw std::runtime_error("cannot open " + path); }
+  if (startsWithBinarySnapshotMagic(in)) {
+    auto view = std::make_unique<SnapshotView>(path);
+    if (view->getVersion() >= 3) { return std::make_unique<LazySnapshotTree>(std::move(view)); }
+    return std::make_unique<LazySnapshotTree>(FlatTree::fromSnapshot(*view));
+  }
+  std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  if (hasCompressedSnapshotMagic(data)) {
+    FlatTree tree;
+    readCompressedSnapshot(data, tree);
+    return std::make_unique<LazySnapshotTree>(std::move(tree));
+  }
+  return std::make_unique<LazySnapshotTree>(FlatTree::fromText(data));
+}
+
+// 벤치마크용 합성 트리 설정
+//   depth: 디렉터리 깊이 (루트 아래 단계 수), fanout: 디렉터리마다 하위 디렉터리 수, files: 디렉터리마다 파일 수
+//   이름 길이는 nameLength 근처에서 고르게, 파일 크기는 평균이 meanFileSize인 지수 분포로 뽑음
+struct SyntheticTreeSpec {
+  int depth = 4;
+  int fanout = 8;
+  int files = 16;
+  int nameLength = 12;
+  long long meanFileSize = 4096;
+  uint64_t seed = 1;
+};
+
+// spec대로 트리를 만들면서 builder에 전위 순서로 알림 (SnapshotParser::parse와 같은 인터페이스)
+// 같은 seed면 항상 같은 트리가 나옴. 이름 앞에 순번을 붙여서 한 디렉터리 안에서 겹치지 않게 함
+template <typename Builder>
+void generateSyntheticTree(const SyntheticTreeSpec &spec, std::string_view rootName, Builder &builder) {
+  struct Frame {
+    int depth;
+    int nextDir;
+  };
+  std::mt19937_64 rng(spec.seed);
+  std::uniform_int_distribution<int> lengthDist(std::max(1, spec.nameLength / 2), std::max(1, spec.nameLength * 3 / 2));
+  std::uniform_int_distribution<int> letterDist('a', 'z');
+  std::exponential_distribution<double> sizeDist(1.0 / static_cast<double>(std::max(1LL, spec.meanFileSize)));
+  auto makeName = [&](char kind, int index) {
+    std::string result(1, kind);
+    result += std::to_string(index);
+    result.push_back('_');
+    for (int i = lengthDist(rng); i > 0; --i) { result.push_back(static_cast<char>(letterDist(rng))); }
+    return result;
+  };
+  auto openDirectory = [&](std::string_view dirName, int depth, std::vector<Frame> &stack) {
+    int subDirs = depth < spec.depth ? spec.fanout : 0;
+    builder.beginDirectory(dirName, subDirs + spec.files);
+    for (int i = 0; i < spec.files; ++i) {
+      builder.addFile(makeName('f', i), static_cast<long long>(sizeDist(rng)));
+    }
+    stack.push_back({depth, 0});
+  };
+
+  std::vector<Frame> stack;
+  openDirectory(rootName, 0, stack);
+  while (!stack.empty()) {
+    Frame &top = stack.back();
+    if (top.depth >= spec.depth || top.nextDir == spec.fanout) {
+      stack.pop_back();
+      builder.endDirectory();
+      continue;
+    }
+    int index = top.nextDir++;
+    int depth = top.depth + 1;
+    openDirectory(makeName('d', index), depth, stack);
+  }
+}
+
+// 합성 트리를 실제 디렉터리와 파일로 만드는 builder (파일은 ftruncate로 크기만 맞춘 빈 파일)
+class DiskTreeBuilder {
+  private:
+    std::vector<fs::path> stack;
+    fs::path rootPath;
+  public:
+    explicit DiskTreeBuilder(const fs::path &root): rootPath(root) {}
+
+    void beginDirectory(std::string_view dirName, long long) {
+      fs::path dir = stack.empty() ? rootPath : stack.back() / std::string(dirName);
+      fs::create_directories(dir);
+      stack.push_back(std::move(dir));
+    }
+    void addFile(std::string_view fileName, long long fileSize) {
+      fs::path file = stack.back() / std::string(fileName);
+      std::ofstream(file, std::ios::binary);
+      fs::resize_file(file, static_cast<uintmax_t>(fileSize));
+    }
+    void endDirectory() { stack.pop_back(); }
+};
+
+// 벤치마크 한 항목의 결과
+struct BenchResult {
+  std::string name;
+  std::vector<double> seconds;  // 반복마다 걸린 시간
+  long long nodes = 0;          // 한 번에 처리한 노드 수
+  long long bytes = 0;          // 한 번에 처리한 바이트 수 (없으면 0)
+};
+
+// warmup번 버리고 reps번 잰 결과. body는 처리한 바이트 수를 반환
+template <typename Body>
+BenchResult runBenchmark(const std::string &name, int warmup, int reps, long long nodes, Body &&body) {
+  BenchResult result;
+  result.name = name;
+  result.nodes = nodes;
+  for (int i = 0; i < warmup; ++i) { body(); }
+  for (int i = 0; i < reps; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    result.bytes = body();
+    auto stop = std::chrono::steady_clock::now();
+    result.seconds.push_back(std::chrono::duration<double>(stop - start).count());
+  }
+  return result;
+}
+
+// 결과를 JSON 한 덩어리로 출력 (이름에는 따옴표나 역슬래시가 없다고 가정)
+void writeBenchJson(std::ostream &out, const SyntheticTreeSpec &spec, long long nodes, unsigned threadCount,
+                    const std::vector<BenchResult> &results) {
+  out << "{\n  \"spec\": {\"depth\": " << spec.depth << ", \"fanout\": " << spec.fanout << ", \"files\": " << spec.files
+      << ", \"nameLength\": " << spec.nameLength << ", \"meanFileSize\": " << spec.meanFileSize
+      << ", \"seed\": " << spec.seed << ", \"nodes\": " << nodes << ", \"threads\": " << threadCount << "},\n";
+  out << "  \"results\": [";
+  out << std::fixed << std::setprecision(9);
+  for (size_t i = 0; i < results.size(); ++i) {
+    const BenchResult &r = results[i];
+    std::vector<double> sorted = r.seconds;
+    std::sort(sorted.begin(), sorted.end());
+    double best = sorted.empty() ? 0 : sorted.front();
+    double median = sorted.empty() ? 0 : sorted[sorted.size() / 2];
+    double mean = sorted.empty() ? 0 : std::accumulate(sorted.begin(), sorted.end(), 0.0) / static_cast<double>(sorted.size());
+    double nodesPerSec = median > 0 ? static_cast<double>(r.nodes) / median : 0;
+    double mbPerSec = median > 0 ? static_cast<double>(r.bytes) / median / 1e6 : 0;
+    out << (i ? ",\n" : "\n") << "    {\"name\": \"" << r.name << "\", \"reps\": " << sorted.size() << ", \"minSec\": " << best
+        << ", \"medianSec\": " << median << ", \"meanSec\": " << mean << ", \"nodes\": " << r.nodes
+        << ", \"bytes\": " << r.bytes << ", \"nodesPerSec\": " << std::setprecision(1) << nodesPerSec
+        << ", \"mbPerSec\": " << mbPerSec << std::setprecision(9) << "}";
+  }
+  out << "\n  ]\n}" << std::endl;
+}
+
+// --bench: 합성 트리로 scan/getSize/display/serialize/deserialize를 따로 재서 JSON으로 출력
+// benchDir가 있으면 그 아래에 트리를 실제로 만들고 스캔까지 잼 (getSize는 캐시를 다시 계산하는 시간)
+int runBenchmarks(const SyntheticTreeSpec &spec, const std::string &benchDir, int warmup, int reps,
+                  unsigned threadCount, ScanBackend &backend) {
+  Directory tree(".");
+  ComponentTreeBuilder builder(tree);
+  generateSyntheticTree(spec, ".", builder);
+  long long nodes = 1 + tree.getFileCount() + tree.getDirectoryCount();
+
+  std::vector<BenchResult> results;
+  if (!benchDir.empty()) {
+    if (fs::exists(benchDir) && !fs::is_empty(benchDir)) {
+      std::cerr << benchDir << ": must be empty or not exist" << std::endl;
+      return 1;
+    }
+    DiskTreeBuilder disk(benchDir);
+    generateSyntheticTree(spec, ".", disk);
+    results.push_back(runBenchmark("scan", warmup, reps, nodes, [&] {
+      Directory scanned(".");
+      if (threadCount > 0) {
+        buildFileststemTreeParallel(benchDir, &scanned, threadCount, backend);
       } else {
-        std::cout << getName() << "/ (total " << getSize() << " bytes)" << std::endl;
+        buildFileststemTree(benchDir, &scanned, backend);
       }
+      return 0LL;
+    }));
+  }
+  results.push_back(runBenchmark("getSize", warmup, reps, nodes, [&] {
+    if (threadCount > 0) {
+      recomputeTotalsParallel(tree, threadCount);
+    } else {
+      tree.recomputeTotals();
+    }
+    return 0LL;
+  }));
+  results.push_back(runBenchmark("display", warmup, reps, nodes, [&] {
+    CountingSink sink;
+    tree.display(sink);
+    sink.flush();
+    return sink.getCount();
+  }));
+  std::string text;
+  results.push_back(runBenchmark("serialize", warmup, reps, nodes, [&] {
+    StringSink sink;
+    if (threadCount > 0) {
+      serializeTreeParallel(tree, sink, threadCount);
+    } else {
+      tree.serialize(sink);
+    }
+    text = sink.take();
+    return static_cast<long long>(text.size());
+  }));
+  // 직렬화 + 개수 + 해시: 세 번 도는 것과 foldTree() 한 번으로 합친 것
+  results.push_back(runBenchmark("serialize+count+hash (3 walks)", warmup, reps, nodes, [&] {
+    CountingSink sink;
+    SerializeFold serialize(sink);
+    CountFold count;
+    HashFold hash;
+    foldTree(tree, serialize);
+    foldTree(tree, count);
+    foldTree(tree, hash);
+    sink.flush();
+    return sink.getCount() + static_cast<long long>(hash.result & 1) + (count.files & 1);
+  }));
+  results.push_back(runBenchmark("serialize+count+hash (fused)", warmup, reps, nodes, [&] {
+    CountingSink sink;
+    SerializeFold serialize(sink);
+    CountFold count;
+    HashFold hash;
+    foldTree(tree, serialize, count, hash);
+    sink.flush();
+    return sink.getCount() + static_cast<long long>(hash.result & 1) + (count.files & 1);
+  }));
+  // 노드를 만들지 않고 파서만 (이름과 크기를 훑기만 하는 builder)
+  results.push_back(runBenchmark("parse", warmup, reps, nodes, [&] {
+    struct ParseOnly {
+      long long checksum = 0;
+      void beginDirectory(std::string_view dirName, long long) { checksum += static_cast<long long>(dirName.size()); }
+      void addFile(std::string_view fileName, long long fileSize) { checksum += static_cast<long long>(fileName.size()) + fileSize; }
+      void endDirectory() {}
+      void addCollapsedDirectory(std::string_view, long long, long long, long long) {}
+    } sink;
+    SnapshotParser(text).parse(sink);
+    return static_cast<long long>(text.size()) + (sink.checksum & 1);
+  }));
+  results.push_back(runBenchmark("deserialize", warmup, reps, nodes, [&] {
+    Directory restored("");
+    restored.deserialize(text);
+    return static_cast<long long>(text.size());
+  }));
+  writeBenchJson(std::cout, spec, nodes, threadCount, results);
+  return 0;
+}
 
-      for (FilesystemComponent *child: children) {
-        if (child) { child->display(indent + 1); }
+// 명령행 옵션
+struct Options {
+  unsigned threadCount = 0;  // 스캔 스레드 수 (0이면 기존의 단일 스레드 DFS 사용)
+  std::string backendName = "std";
+  unsigned queueDepth = 256;  // --backend uring의 동시 요청 수
+  bool showStats = false;
+  bool useArena = false;
+  std::string savePath;
+  std::string saveBinaryPath;
+  std::string openBinaryPath;
+  std::string saveCompressedPath;
+  std::string openCompressedPath;
+  std::string incrementalPath;
+  bool watch = false;
+  std::vector<std::string> sizeQueries;
+  bool flat = false;
+  bool bench = false;
+  SyntheticTreeSpec benchSpec;
+  std::string benchDir;
+  int benchWarmup = 1;
+  int benchReps = 5;
+  std::string metricsFormat;  // "summary" 또는 "prometheus" (FS_INSTRUMENT로 빌드했을 때만)
+  std::string tracePath;
+  std::string streamPath;
+  std::string lazyPath;     // --lazy SNAPSHOT
+  std::string diffOldPath;  // --diff OLD NEW
+  std::string diffNewPath;
+  size_t topCount = 0;  // --top K
+  TopKKind topKind = TopKKind::All;
+  std::vector<std::string> shardPaths;  // --shard PATH: "." 대신 스캔할 경로들 (같은 경로 자리에 합침)
+  std::vector<std::string> shardCuts;   // --shard-at PATH: 읽지 않고 빈 디렉터리로 남길 경로
+  std::vector<std::string> mergePaths;  // --merge SNAPSHOT: 스캔하지 않고 스냅샷들을 합침
+  ScanPolicy scanPolicy;                // --dedup-links, --disk-usage, --symlinks follow|skip, --max-depth N
+  ScanFilter scanFilter;                // --include/--exclude GLOB, --include-regex/--exclude-regex RE, --min-size N, -x
+};
+
+// 잘못된 옵션이면 false
+bool parseOptions(int argc, char *argv[], Options &options) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--backend" && hasValue) {
+      options.backendName = argv[++i];
+    } else if (arg == "--queue-depth" && hasValue) {
+      options.queueDepth = static_cast<unsigned>(std::stoul(argv[++i]));
+    } else if (arg == "--stats") {
+      options.showStats = true;
+    } else if (arg == "--arena") {
+      options.useArena = true;
+    } else if (arg == "--save" && hasValue) {
+      options.savePath = argv[++i];
+    } else if (arg == "--save-binary" && hasValue) {
+      options.saveBinaryPath = argv[++i];
+    } else if (arg == "--save-compressed" && hasValue) {
+      options.saveCompressedPath = argv[++i];
+    } else if (arg == "--open-compressed" && hasValue) {
+      options.openCompressedPath = argv[++i];
+    } else if (arg == "--open-binary" && hasValue) {
+      options.openBinaryPath = argv[++i];
+    } else if (arg == "--size" && hasValue) {
+      options.sizeQueries.push_back(argv[++i]);
+    } else if (arg == "--bench") {
+      options.bench = true;
+    } else if (arg == "--bench-dir" && hasValue) {
+      options.benchDir = argv[++i];
+    } else if (arg == "--depth" && hasValue) {
+      options.benchSpec.depth = std::stoi(argv[++i]);
+    } else if (arg == "--fanout" && hasValue) {
+      options.benchSpec.fanout = std::stoi(argv[++i]);
+    } else if (arg == "--files" && hasValue) {
+      options.benchSpec.files = std::stoi(argv[++i]);
+    } else if (arg == "--name-length" && hasValue) {
+      options.benchSpec.nameLength = std::stoi(argv[++i]);
+    } else if (arg == "--mean-size" && hasValue) {
+      options.benchSpec.meanFileSize = std::stoll(argv[++i]);
+    } else if (arg == "--seed" && hasValue) {
+      options.benchSpec.seed = std::stoull(argv[++i]);
+    } else if (arg == "--warmup" && hasValue) {
+      options.benchWarmup = std::stoi(argv[++i]);
+    } else if (arg == "--reps" && hasValue) {
+      options.benchReps = std::stoi(argv[++i]);
+    } else if (arg == "--metrics" && hasValue) {
+      options.metricsFormat = argv[++i];
+    } else if (arg == "--trace" && hasValue) {
+      options.tracePath = argv[++i];
+    } else if (arg == "--stream" && hasValue) {
+      options.streamPath = argv[++i];
+    } else if (arg == "--top" && hasValue) {
+      options.topCount = static_cast<size_t>(std::stoul(argv[++i]));
+    } else if (arg == "--top-kind" && hasValue) {
+      std::string kindName = argv[++i];
+      if (kindName == "files") {
+        options.topKind = TopKKind::Files;
+      } else if (kindName == "dirs") {
+        options.topKind = TopKKind::Directories;
+      } else if (kindName == "all") {
+        options.topKind = TopKKind::All;
+      } else {
+        return false;
       }
+    } else if (arg == "--dedup-links") {
+      options.scanPolicy.dedupHardLinks = true;
+    } else if (arg == "--disk-usage") {
+      options.scanPolicy.diskUsage = true;
+    } else if (arg == "--symlinks" && hasValue) {
+      std::string policyName = argv[++i];
+      if (policyName == "follow") {
+        options.scanPolicy.symlinks = SymlinkPolicy::Follow;
+      } else if (policyName == "skip") {
+        options.scanPolicy.symlinks = SymlinkPolicy::Skip;
+      } else {
+        return false;
+      }
+    } else if (arg == "--max-depth" && hasValue) {
+      options.scanPolicy.maxDepth = std::stoi(argv[++i]);
+    } else if (arg == "--include" && hasValue) {
+      options.scanFilter.includeGlobs.push_back(argv[++i]);
+    } else if (arg == "--exclude" && hasValue) {
+      options.scanFilter.excludeGlobs.push_back(argv[++i]);
+    } else if (arg == "--include-regex" && hasValue) {
+      options.scanFilter.includeRegexes.push_back(argv[++i]);
+    } else if (arg == "--exclude-regex" && hasValue) {
+      options.scanFilter.excludeRegexes.push_back(argv[++i]);
+    } else if (arg == "--min-size" && hasValue) {
+      options.scanFilter.minFileSize = std::stoll(argv[++i]);
+    } else if (arg == "-x" || arg == "--one-file-system") {
+      options.scanFilter.oneFileSystem = true;
+    } else if (arg == "--shard" && hasValue) {
+      options.shardPaths.push_back(argv[++i]);
+    } else if (arg == "--shard-at" && hasValue) {
+      options.shardCuts.push_back(argv[++i]);
+    } else if (arg == "--merge" && hasValue) {
+      options.mergePaths.push_back(argv[++i]);
+    } else if (arg == "--lazy" && hasValue) {
+      options.lazyPath = argv[++i];
+    } else if (arg == "--diff" && i + 2 < argc) {
+      options.diffOldPath = argv[++i];
+      options.diffNewPath = argv[++i];
+    } else if (arg == "--flat") {
+      options.flat = true;
+    } else if (arg == "--watch") {
+      options.watch = true;
+    } else if (arg == "--incremental" && hasValue) {
+      options.incrementalPath = argv[++i];
+    } else if ((arg == "-j" || arg == "--threads") && hasValue && std::isdigit(static_cast<unsigned char>(argv[i + 1][0]))) {
+      options.threadCount = static_cast<unsigned>(std::stoul(argv[++i]));
+    } else if (arg == "-j" || arg == "--threads") {
+      options.threadCount = std::max(1u, std::thread::hardware_concurrency());
+    } else {
+      return false;
     }
-    // 외부에서 자식 목록에 접근해야 할 경우 사용하는 함수
-    std::vector<FilesystemComponent *> &getChildren() { return children; }
+  }
+  return true;
+}
 
-    // 과제2
-    std::string serialize() const override {
-      std::ostringstream oss;
-      oss << "D|" << getName() << "|" << children.size() << "[";
-      // 모든 자식들 재귀적으로 serialiez 호출하여 문자열에 추가
-      for (const auto* child: children) {
-        if (child) { oss << child->serialize(); }
-      }
-      oss << "]";
-      return oss.str();
-    }
-
-    // 직렬화된 문자열로부터 디렉터리 객체의 상태와 하위 구조 복원
-    void deserialize(const std::string& data) override {
-      for (FilesystemComponent* child: this->children) { delete child; }
-      this->children.clear();
-
-      size_t first_pipe = data.find('|');
-      size_t second_pipe = data.find('|', first_pipe+1);
-      size_t bracket_open = data.find('[', second_pipe+1);
-
-      this->name = data.substr(first_pipe+1, second_pipe - (first_pipe+1));
-      int num_children = 0;
-      if (second_pipe != std::string::npos && bracket_open != std::string::npos && bracket_open > second_pipe+1) {
-        num_children = std::stoi(data.substr(second_pipe + 1, bracket_open - (second_pipe + 1)));
-      }
-
-      // 자식 없으면 바로 반환
-      if (num_children == 0) { return; }
-
-      size_t current_pos = bracket_open+1;
-
-      for (int i = 0; i < num_children; ++i) {
-        if (current_pos >= data.length()-1 || data[current_pos] == ']')
-          break;
-
-        char child_type = data[current_pos];
-        size_t segment_start = current_pos;
-        size_t scan_pos = current_pos;
-
-        if (child_type == 'F') {
-          size_t p1 = data.find('|', scan_pos+1);
-          size_t p2 = std::string::npos;
-          if (p1 != std::string::npos) p2 = data.find('|', p1+1);
-
-          size_t temp_end = (p2 != std::string::npos) ? p2+1 : data.length();
-          while (temp_end < data.length() && std::isdigit(data[temp_end]))
-          temp_end++;
-          scan_pos = temp_end;
-        } else if (child_type == 'D') {
-          scan_pos++;
-          int bracket_balance = 0;
-          bool found_child_opening_bracket = false;
-          size_t child_content_start_bracket = data.find('[', scan_pos);
-
-          if (child_content_start_bracket != std::string::npos) {
-            scan_pos = child_content_start_bracket;
-          } else {
-            scan_pos = data.length();
-          }
+// 텍스트/바이너리 스냅샷을 파일로 바로 흘려 씀 (문자열을 통째로 만들지 않음)
+bool saveTextSnapshot(const std::string &path, const FilesystemComponent &root) {
+  std::ofstream snapshot(path, std::ios::binary);
+  StreamSink sink(snapshot);
+  root.serialize(sink);
+  sink.flush();
+  return static_cast<bool>(snapshot);
+}
 
-          while(scan_pos < data.length()) {
-            if (data[scan_pos] == '[') {
-              bracket_balance++;
-              found_child_opening_bracket = true;
-            } else if (data[scan_pos] == ']') {
-              bracket_balance--;
-            }
+bool saveBinarySnapshot(const std::string &path, const FilesystemComponent &root) {
+  std::ofstream snapshot(path, std::ios::binary);
+  StreamSink sink(snapshot);
+  BinarySnapshotWriter().write(root, sink);
+  sink.flush();
+  return static_cast<bool>(snapshot);
+}
 
-            if (found_child_opening_bracket && bracket_balance == 0) {
-              scan_pos++;
-              break;
-            }
-            scan_pos++;
-          }
-        } else {
-          break;
-        }
+bool saveCompressedSnapshot(const std::string &path, const Directory &root, unsigned threadCount) {
+  std::ofstream snapshot(path, std::ios::binary);
+  StreamSink sink(snapshot);
+  CompressedSnapshotWriter(sink, threadCount).write(root);
+  sink.flush();
+  return static_cast<bool>(snapshot);
+}
+
+// 텍스트(serialize()), 바이너리, 압축 스냅샷 파일을 root로 불러옴 (앞 4바이트로 구분)
+void loadSnapshotFile(const std::string &path, Directory &root, unsigned threadCount = 1) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) { throw std::runtime_error("cannot open " + path); }
+  if (startsWithBinarySnapshotMagic(in)) {
+    SnapshotView(path).materialize(root);
+    return;
+  }
+  std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  if (hasCompressedSnapshotMagic(text)) {
+    ComponentTreeBuilder builder(root);
+    readCompressedSnapshot(text, builder, threadCount);
+    return;
+  }
+  root.deserialize(text);
+}
+
+int main(int argc, char *argv[]) {
+  Options options;
+  if (!parseOptions(argc, argv, options)) {
+    std::cerr << "usage: " << argv[0]
+              << " [-j|--threads [N]] [--backend std|posix|uring] [--queue-depth N] [--stats] [--arena]"
+                 " [--save FILE] [--save-binary FILE] [--open-binary FILE] [--save-compressed FILE] [--open-compressed FILE]"
+                 " [--incremental FILE] [--watch] [--size PATH]... [--flat]"
+                 " [--bench [--bench-dir DIR] [--depth N] [--fanout N] [--files N] [--name-length N] [--mean-size N]"
+                 " [--seed N] [--warmup N] [--reps N]] [--metrics summary|prometheus] [--trace FILE]"
+                 " [--stream FILE|-] [--top K [--top-kind files|dirs|all]]"
+                 " [--diff OLD NEW] [--lazy SNAPSHOT [--size PATH]... [--top K]]"
+                 " [--shard PATH]... [--shard-at PATH]... [--merge SNAPSHOT]..."
+                 " [--dedup-links] [--disk-usage] [--symlinks follow|skip] [--max-depth N]"
+                 " [--include GLOB]... [--exclude GLOB]... [--include-regex RE]... [--exclude-regex RE]..."
+                 " [--min-size N] [-x|--one-file-system]"
+              << std::endl;
+    return 1;
+  }
+  std::unique_ptr<ScanBackend> backend;
+  try {
+    backend = makeScanBackend(options.backendName, options.queueDepth);
+  } catch (const std::system_error &e) {
+    // io_uring을 막아 둔 커널/컨테이너에서는 POSIX 백엔드로 대신함
+    std::cerr << options.backendName << " backend unavailable (" << e.what() << "), using posix" << std::endl;
+    backend = makeScanBackend("posix");
+  }
+  if (!backend) {
+    std::cerr << "unknown backend: " << options.backendName << std::endl;
+    return 1;
+  }
+  backend->policy = options.scanPolicy;
+  if (!options.metricsFormat.empty() && options.metricsFormat != "summary" && options.metricsFormat != "prometheus") {
+    std::cerr << "unknown metrics format: " << options.metricsFormat << std::endl;
+    return 1;
+  }
+#ifdef FS_INSTRUMENT
+  InstrumentationReport report(options.metricsFormat, options.tracePath);
+#else
+  if (!options.metricsFormat.empty() || !options.tracePath.empty()) {
+    std::cerr << "instrumentation is disabled (rebuild with -DFS_INSTRUMENT)" << std::endl;
+    return 1;
+  }
+#endif
+
+  if (!options.openCompressedPath.empty()) {
+    // 압축 스냅샷을 블록 단위로 병렬로 풀어서 노드 객체 없이 배열 트리로 출력
+    try {
+      std::ifstream in(options.openCompressedPath, std::ios::binary);
+      if (!in) { throw std::runtime_error("cannot open " + options.openCompressedPath); }
+      std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+      FlatTree tree;
+      readCompressedSnapshot(data, tree, std::max(1u, options.threadCount));
+      StreamSink sink(std::cout);
+      tree.display(sink);
+    } catch (const std::exception &e) {
+      std::cerr << options.openCompressedPath << ": " << e.what() << std::endl;
+      return 1;
+    }
+    return 0;
+  }
 
-        std::string child_segment_str = data.substr(segment_start, scan_pos - segment_start);
+  if (!options.openBinaryPath.empty()) {
+    // 스캔 없이 바이너리 스냅샷을 mmap 해서 바로 출력
+    try {
+      SnapshotView view(options.openBinaryPath);
+      StreamSink sink(std::cout);
+      view.display(sink);
+    } catch (const std::exception &e) {
+      std::cerr << options.openBinaryPath << ": " << e.what() << std::endl;
+      return 1;
+    }
+    return 0;
+  }
+
+  if (options.bench) {
+    try {
+      return runBenchmarks(options.benchSpec, options.benchDir, options.benchWarmup, options.benchReps,
+                           options.threadCount, *backend);
+    } catch (const std::exception &e) {
+      std::cerr << "bench: " << e.what() << std::endl;
+      return 1;
+    }
+  }
 
-        FilesystemComponent* child = nullptr;
-        if (child_type == 'F') {
-          child = new File("", 0); 
-        } else if (child_type == 'D') {
-          child = new Directory(""); 
+  if (!options.lazyPath.empty()) {
+    // 스냅샷을 지연 트리로 열고 질의에 필요한 디렉터리만 펼침 (질의가 없으면 전체 출력)
+    std::unique_ptr<LazySnapshotTree> lazy;
+    try {
+      lazy = LazySnapshotTree::open(options.lazyPath);
+    } catch (const std::exception &e) {
+      std::cerr << options.lazyPath << ": " << e.what() << std::endl;
+      return 1;
+    }
+    Directory &lazyRoot = lazy->getRoot();
+    // 바이너리 스냅샷은 펼칠 때 읽으므로 손상된 곳은 그 디렉터리에 닿았을 때 알게 됨
+    try {
+      for (const std::string &query: options.sizeQueries) {
+        std::optional<long long> size = lazyRoot.getSize(query);
+        if (size) {
+          std::cout << query << ": " << *size << " bytes" << std::endl;
         } else {
-          continue; 
+          std::cout << query << ": not found" << std::endl;
         }
-
-        if (child) {
-          child->deserialize(child_segment_str); 
-          this->add(child); 
+      }
+      if (options.topCount > 0) {
+        for (const SizeRank &rank: TopKQuery(options.topCount, options.topKind).run(lazyRoot)) {
+          std::cout << rank.size << " " << treePathOf(*rank.node, lazyRoot) << (rank.node->isDirectory() ? "/" : "")
+                    << std::endl;
         }
-        current_pos = scan_pos; 
       }
+      if (options.sizeQueries.empty() && options.topCount == 0) { lazyRoot.display(); }
+    } catch (const std::exception &e) {
+      std::cerr << options.lazyPath << ": " << e.what() << std::endl;
+      return 1;
     }
-};
+    if (options.showStats) { std::cerr << "lazy: " << lazy->loadedDirectories << " directories expanded" << std::endl; }
+    return 0;
+  }
 
-void buildFileststemTree(const fs::path &currentPath, Directory *parentDir, bool isRoot = false) {
-  if (!parentDir) return;
+  if (!options.diffOldPath.empty()) {
+    // 스냅샷 두 개(텍스트 또는 바이너리)를 비교해서 바뀐 경로만 출력
+    Directory before("");
+    Directory after("");
+    for (auto [path, dir]: {std::pair(&options.diffOldPath, &before), std::pair(&options.diffNewPath, &after)}) {
+      try {
+        loadSnapshotFile(*path, *dir);
+      } catch (const std::exception &e) {
+        std::cerr << *path << ": " << e.what() << std::endl;
+        return 1;
+      }
+    }
+    long long total = 0;
+    for (const DiffEntry &entry: diffTrees(before, after)) {
+      const char *mark = entry.kind == DiffEntry::Added ? "+ " : entry.kind == DiffEntry::Removed ? "- " : "~ ";
+      std::cout << mark << entry.path << (entry.isDirectory ? "/" : "") << " (" << entry.oldSize << " -> "
+                << entry.newSize << ", " << std::showpos << entry.delta() << std::noshowpos << " bytes)" << std::endl;
+      total += entry.delta();
+    }
+    std::cout << "total " << std::showpos << total << std::noshowpos << " bytes" << std::endl;
+    return 0;
+  }
+
+  fs::path currentPath = ".";
+  // --shard-at으로 정한 디렉터리는 스캔하지 않음 (감시도 같은 자리를 비워 둠)
+  std::unique_ptr<ShardCutBackend> cutBackend;
+  if (!options.shardCuts.empty()) { cutBackend = std::make_unique<ShardCutBackend>(*backend, options.shardCuts); }
+  ScanBackend &cutOrBase = cutBackend ? static_cast<ScanBackend &>(*cutBackend) : *backend;
+  // 필터에 걸린 항목은 스캐너에 알리지 않으므로 빠진 디렉터리는 열리지 않음
+  std::unique_ptr<FilteredScanBackend> filterBackend;
+  try {
+    if (!options.scanFilter.empty()) { filterBackend = std::make_unique<FilteredScanBackend>(cutOrBase, options.scanFilter); }
+  } catch (const std::regex_error &e) {
+    std::cerr << "invalid regex: " << e.what() << std::endl;
+    return 1;
+  }
+  ScanBackend &scanBackend = filterBackend ? static_cast<ScanBackend &>(*filterBackend) : cutOrBase;
+  if (scanBackend.policy.maxDepth >= 0 && (!options.streamPath.empty() || options.flat)) {
+    // 스트리밍/배열 트리에는 디렉터리 합계를 따로 둘 곳이 없음
+    std::cerr << "--max-depth needs a node tree (not --stream or --flat)" << std::endl;
+    return 1;
+  }
+  if (!options.incrementalPath.empty() && (scanBackend.policy.dedupHardLinks || scanBackend.policy.maxDepth >= 0)) {
+    // 재사용한 디렉터리의 파일은 inode를 모르고, 증분 스냅샷은 바이너리라서 접힌 합계를 둘 곳이 없음
+    std::cerr << "--incremental does not support --dedup-links or --max-depth" << std::endl;
+    return 1;
+  }
+  if (scanBackend.policy.maxDepth >= 0 && options.watch) {
+    // 접힌 디렉터리에는 자식을 붙일 수 없으므로 그 안의 이벤트를 반영할 수 없음
+    std::cerr << "--watch does not support --max-depth" << std::endl;
+    return 1;
+  }
+  if (scanBackend.policy.maxDepth >= 0 && (!options.saveBinaryPath.empty() || !options.saveCompressedPath.empty())) {
+    // 접힌 디렉터리의 합계는 텍스트 스냅샷(--save)에만 남음
+    std::cerr << "--max-depth can only be saved as a text snapshot (not --save-binary or --save-compressed)" << std::endl;
+    return 1;
+  }
+  if (!options.streamPath.empty()) {
+    // 트리를 만들지 않고 스캔 결과를 텍스트 스냅샷으로 바로 씀 ("-"면 표준 출력)
+    std::ofstream file;
+    if (options.streamPath != "-") { file.open(options.streamPath, std::ios::binary); }
+    std::ostream &out = options.streamPath == "-" ? std::cout : file;
+    StreamSink sink(out);
+    SnapshotStreamWriter writer(sink);
+    try {
+      scanTree(currentPath, ".", scanBackend, writer);
+    } catch (const std::exception &e) {
+      std::cerr << "stream: " << e.what() << std::endl;
+      return 1;
+    }
+    sink.flush();
+    if (!out) {
+      std::cerr << "failed to write " << options.streamPath << std::endl;
+      return 1;
+    }
+    if (options.showStats) {
+      std::cerr << "stream: " << writer.totalSize << " bytes, " << writer.fileCount << " files, " << writer.dirCount
+                << " directories" << std::endl;
+    }
+    return 0;
+  }
+
+  if (options.flat) {
+    // 노드 객체 대신 평탄한 배열 트리로 같은 과제1/과제2 출력을 만듦
+    FlatTree flatTree = FlatTree::fromScan(currentPath, ".", scanBackend);
+    StreamSink sink(std::cout);
+    sink.write("과제1:\n");
+    flatTree.display(sink);
+    StringSink opaque;
+    flatTree.serialize(opaque);
+    sink.write("\n 과제2:\n");
+    FlatTree::fromText(opaque.str()).display(sink);
+    return 0;
+  }
 
-  for (auto &entry: fs::directory_iterator(currentPath)) {
-    std::string entryName = entry.path().filename().string();
+  // --arena 이면 노드를 FilesystemTree의 arena에서 할당하고 트리 단위로 한 번에 해제
+  std::unique_ptr<FilesystemTree> tree;
+  std::unique_ptr<FilesystemTree> newTree;
+  Directory *root = nullptr;
+  if (options.useArena) {
+    tree = std::make_unique<FilesystemTree>(".");
+    root = tree->getRoot();
+  } else {
+    root = new Directory(".");
+  }
+  ComponentPtr rootOwner(root);
 
-    if (fs::is_regular_file(entry.status())) {
-      long long fileSize = fs::file_size(entry.path());
-      parentDir->add(new File(entryName, fileSize));
-    } else if (fs::is_directory(entry.status())) {
-      Directory *subDir = new Directory(entryName);
-      parentDir->add(subDir);
-      buildFileststemTree(entry.path(), subDir);
+  if (!options.mergePaths.empty()) {
+    // 스냅샷(기준 스캔과 샤드들)을 차례로 불러 합침. 노드는 root와 같은 방식으로 만들어 옮기기만 함
+    for (const std::string &path: options.mergePaths) {
+      ComponentPtr shard(root->createDirectory(""));
+      try {
+        loadSnapshotFile(path, static_cast<Directory &>(*shard), std::max(1u, options.threadCount));
+      } catch (const std::exception &e) {
+        std::cerr << path << ": " << e.what() << std::endl;
+        return 1;
+      }
+      mergeTrees(*root, static_cast<Directory &>(*shard));
+    }
+  } else if (!options.shardPaths.empty()) {
+    try {
+      for (const std::string &path: options.shardPaths) { scanShard(path, *root, options.threadCount, scanBackend); }
+    } catch (const std::exception &e) {
+      std::cerr << "shard: " << e.what() << std::endl;
+      return 1;
     }
+  } else if (!options.incrementalPath.empty()) {
+    // 이전 스냅샷이 있으면 불러와서 바뀐 디렉터리만 다시 읽고, 결과를 같은 파일에 다시 저장
+    IncrementalScanner scanner(scanBackend);
+    try {
+      if (fs::exists(options.incrementalPath)) { SnapshotView(options.incrementalPath).materialize(*root); }
+    } catch (const std::exception &e) {
+      std::cerr << options.incrementalPath << ": " << e.what() << ", rescanning everything" << std::endl;
+      root->takeChildren();
+      root->setStamp(DirectoryStamp());
+    }
+    root->setName(".");
+    scanner.rescan(currentPath, *root);
+    if (!saveBinarySnapshot(options.incrementalPath, *root)) {
+      std::cerr << "failed to write " << options.incrementalPath << std::endl;
+      return 1;
+    }
+    if (options.showStats) {
+      std::cerr << "incremental: " << scanner.reusedDirectories << " directories reused, "
+                << scanner.rescannedDirectories << " rescanned" << std::endl;
+    }
+  } else if (options.threadCount > 0) {
+    buildFileststemTreeParallel(currentPath, root, options.threadCount, scanBackend);
+  } else {
+    buildFileststemTree(currentPath, root, scanBackend);
+  }
+  if (options.showStats) {
+    std::cerr << "scan: " << backend->stats.entries << " entries, " << backend->stats.directories
+              << " directories, " << backend->stats.syscalls << " syscalls ("
+              << std::fixed << std::setprecision(2) << backend->stats.syscallsPerEntry()
+              << " per entry)";
+    if (backend->stats.duplicateLinks > 0) { std::cerr << ", " << backend->stats.duplicateLinks << " duplicate links"; }
+    if (backend->stats.skippedCycles > 0) { std::cerr << ", " << backend->stats.skippedCycles << " symlink cycles skipped"; }
+    if (backend->stats.filteredOut > 0) { std::cerr << ", " << backend->stats.filteredOut << " filtered out"; }
+    std::cerr << std::endl;
+  }
+  if (!options.savePath.empty() && !saveTextSnapshot(options.savePath, *root)) {
+    std::cerr << "failed to write " << options.savePath << std::endl;
+    return 1;
+  }
+  if (!options.saveBinaryPath.empty() && !saveBinarySnapshot(options.saveBinaryPath, *root)) {
+    std::cerr << "failed to write " << options.saveBinaryPath << std::endl;
+    return 1;
+  }
+  if (!options.saveCompressedPath.empty() &&
+      !saveCompressedSnapshot(options.saveCompressedPath, *root, std::max(1u, options.threadCount))) {
+    std::cerr << "failed to write " << options.saveCompressedPath << std::endl;
+    return 1;
+  }
+  if (!options.sizeQueries.empty()) {
+    // 경로별 크기만 출력
+    root->enablePathIndex();
+    for (const std::string &query: options.sizeQueries) {
+      std::optional<long long> size = root->getSize(query);
+      if (size) {
+        std::cout << query << ": " << *size << " bytes" << std::endl;
+      } else {
+        std::cout << query << ": not found" << std::endl;
+      }
+    }
+    return 0;
+  }
+
+  if (options.topCount > 0) {
+    // 크기가 큰 순서로 K개만 출력
+    for (const SizeRank &rank: TopKQuery(options.topCount, options.topKind).run(*root, options.threadCount)) {
+      std::cout << rank.size << " " << treePathOf(*rank.node, *root) << (rank.node->isDirectory() ? "/" : "") << std::endl;
+    }
+    return 0;
+  }
+
+  if (options.watch) {
+#ifdef __linux__
+    // 파일시스템 이벤트를 계속 트리에 반영하면서 바뀔 때마다 합계를 한 줄씩 출력 (종료하려면 Ctrl+C)
+    try {
+      // 트리는 감시 스레드(여기)만 고치고, 읽기는 게시된 사본으로 함 (질의 스레드가 늘어도 쓰기를 막지 않음)
+      // 감시도 스캔과 같은 backend를 거치므로 필터, 샤드 자리, 크기 계산 방식이 그대로 적용됨
+      TreeWatcher watcher(*root, currentPath, scanBackend);
+      TreePublisher publisher(*root);
+      while (true) {
+        std::shared_ptr<const FrozenDirectory> view = publisher.snapshot();
+        std::cout << "total " << view->getSize() << " bytes, " << view->getFileCount() << " files, "
+                  << view->getDirectoryCount() << " directories" << std::endl;
+        while (watcher.poll(-1) == 0) {}
+        publisher.publish();
+      }
+    } catch (const std::exception &e) {
+      std::cerr << "watch: " << e.what() << std::endl;
+      return 1;
+    }
+#else
+    std::cerr << "--watch is only supported on Linux" << std::endl;
+    return 1;
+#endif
   }
-}
 
-int main() {
-  fs::path currentPath = ".";
-  Directory *root = new Directory(".");
-  buildFileststemTree(currentPath, root);
   std::cout << "과제1:" << std::endl;
   root->display();
 
   std::cout << "\n 과제2:" << std::endl;
   std::string opaque_data = "";
-  opaque_data = root->serialize();
-  Directory *newRoot = new Directory("");
+  if (options.threadCount > 0) {
+    StringSink opaque;
+    serializeTreeParallel(*root, opaque, options.threadCount);
+    opaque_data = opaque.take();
+  } else {
+    opaque_data = root->serialize();
+  }
+  Directory *newRoot = nullptr;
+  if (options.useArena) {
+    newTree = std::make_unique<FilesystemTree>("");
+    newRoot = newTree->getRoot();
+  } else {
+    newRoot = new Directory("");
+  }
+  ComponentPtr newRootOwner(newRoot);
   newRoot->deserialize(opaque_data);
   newRoot->display(); 
-  delete newRoot;
-
-  delete root;
   return 0;
-}
\ No newline at end of file
+}